@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vds/ConcurrentOrderedSkipListMap.hpp>
+
+// Compares ordered inserts and lookups from several threads into one
+// ConcurrentOrderedSkipListMap against a std::map behind a single mutex.
+
+class LockedMap {
+public:
+    bool insert(std::uint64_t key, std::uint64_t value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return map.emplace(key, value).second;
+    }
+
+    std::size_t count(std::uint64_t key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return map.count(key);
+    }
+private:
+    std::mutex mutex;
+    std::map<std::uint64_t, std::uint64_t> map;
+};
+
+template <typename Map>
+void run(const std::string& name, const std::vector<std::uint64_t>& keys, std::size_t thread_count) {
+    Map map;
+    std::vector<std::thread> threads;
+    std::vector<std::uint64_t> checksums(thread_count);
+    auto per_thread = keys.size() / thread_count;
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            auto first = keys.begin() + t * per_thread;
+            // Every thread inserts its share, then looks up all of it again.
+            for (auto it = first; it != first + per_thread; ++it)
+                map.insert(*it, *it);
+            for (auto it = first; it != first + per_thread; ++it)
+                checksums[t] += map.count(*it);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    std::uint64_t checksum = 0;
+    for (auto part : checksums)
+        checksum += part;
+    auto ops = 2 * per_thread * thread_count;
+    std::cout << name << " x" << thread_count << ": "
+              << ops / std::chrono::duration<double, std::micro>(stop - start).count() << " Mops/s"
+              << " (checksum " << checksum << ")\n";
+}
+
+int main() {
+    std::mt19937_64 generator(42);
+    std::vector<std::uint64_t> keys(1000000);
+    for (auto& key : keys)
+        key = generator();
+
+    auto max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        run<LockedMap>("  locked std::map", keys, thread_count);
+        run<vds::ConcurrentOrderedSkipListMap<std::uint64_t, std::uint64_t>>("  skip list       ", keys, thread_count);
+    }
+}
@@ -0,0 +1,53 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <vds/UnorderedHashMap.hpp>
+#include <vds/UnorderedFlatHashMap.hpp>
+
+// Compares lookups in the chained UnorderedHashMap (a std::list scan per
+// bucket) against the group probing of UnorderedFlatHashMap, for keys that
+// are present and for keys that are not.
+
+template <typename Map>
+void run(const std::string& name, const std::vector<std::uint64_t>& keys, const std::vector<std::uint64_t>& misses) {
+    Map map;
+    for (auto key : keys)
+        map.insert(key, key);
+
+    std::uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto key : keys)
+        checksum += map.find(key)->second;
+    auto middle = std::chrono::steady_clock::now();
+    for (auto key : misses)
+        checksum += map.find(key) == map.end();
+    auto stop = std::chrono::steady_clock::now();
+
+    auto ns_per_op = [](auto duration, std::size_t ops) {
+        return std::chrono::duration<double, std::nano>(duration).count() / ops;
+    };
+    std::cout << name
+              << ": hit " << ns_per_op(middle - start, keys.size()) << " ns/op"
+              << ", miss " << ns_per_op(stop - middle, misses.size()) << " ns/op"
+              << " (load factor " << map.load_factor() << ", checksum " << checksum << ")\n";
+}
+
+int main() {
+    std::mt19937_64 generator(42);
+    for (std::size_t count : {1000u, 100000u, 1000000u}) {
+        // Odd keys are inserted, even keys are guaranteed misses.
+        std::vector<std::uint64_t> keys(count), misses(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            keys[i] = generator() | 1;
+            misses[i] = generator() & ~std::uint64_t{1};
+        }
+
+        std::cout << count << " keys\n";
+        run<vds::UnorderedHashMap<std::uint64_t, std::uint64_t>>("  chained", keys, misses);
+        run<vds::UnorderedFlatHashMap<std::uint64_t, std::uint64_t>>("  flat   ", keys, misses);
+    }
+}
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vds/OrderedArrayMap.hpp>
+
+// Compares lookups in a sorted OrderedArrayMap (std::lower_bound) against its
+// frozen Eytzinger layout, from sizes that fit in L1 up to well past L2.
+
+template <typename Map>
+void run(const std::string& name, Map& map, const std::vector<std::uint64_t>& queries) {
+    std::uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto query : queries) {
+        auto it = map.lower_bound(query);
+        if (it != map.end())
+            checksum += it->second;
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    std::cout << name << ": "
+              << std::chrono::duration<double, std::nano>(stop - start).count() / queries.size() << " ns/op"
+              << " (checksum " << checksum << ")\n";
+}
+
+int main() {
+    std::mt19937_64 generator(42);
+    for (std::size_t count : {1000u, 100000u, 1000000u, 10000000u}) {
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> entries(count);
+        for (auto& entry : entries)
+            entry = {generator(), generator()};
+        vds::OrderedArrayMap<std::uint64_t, std::uint64_t> sorted(entries.begin(), entries.end());
+        auto frozen = sorted.freeze();
+
+        std::vector<std::uint64_t> queries(1000000);
+        for (auto& query : queries)
+            query = generator();
+
+        std::cout << count << " keys\n";
+        run("  sorted", sorted, queries);
+        run("  frozen", frozen, queries);
+    }
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vds/MPMCQueue.hpp>
+#include <vds/Queue.hpp>
+#include <vds/SPSCQueue.hpp>
+
+// Hands messages from producer threads to consumer threads through a
+// vds::Queue behind a single mutex, the SPSC queue and the MPMC queue, one
+// message at a time and in batches.
+
+constexpr std::size_t capacity = 1024;
+constexpr std::size_t batch_size = 32;
+
+class LockedQueue {
+public:
+    explicit LockedQueue(std::size_t) {}
+
+    bool try_push(std::uint64_t message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() == capacity)
+            return false;
+        queue.push(message);
+        return true;
+    }
+
+    template <typename InputIt>
+    std::size_t try_push_n(InputIt first, std::size_t n) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto count = std::min(n, capacity - queue.size());
+        for (std::size_t i = 0; i < count; ++i, ++first)
+            queue.push(*first);
+        return count;
+    }
+
+    bool try_pop(std::uint64_t& message) {
+        return try_pop_n(&message, 1) == 1;
+    }
+
+    template <typename OutputIt>
+    std::size_t try_pop_n(OutputIt out, std::size_t n) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto count = std::min(n, queue.size());
+        for (std::size_t i = 0; i < count; ++i, ++out) {
+            *out = queue.front();
+            queue.pop();
+        }
+        return count;
+    }
+private:
+    std::mutex mutex;
+    vds::Queue<std::uint64_t> queue;
+};
+
+template <typename Queue>
+void run(const std::string& name, std::size_t messages, std::size_t producers, std::size_t consumers, bool batched) {
+    Queue queue(capacity);
+    std::vector<std::thread> threads;
+    std::vector<std::uint64_t> checksums(consumers);
+    auto per_producer = messages / producers;
+    auto per_consumer = per_producer * producers / consumers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < producers; ++t) {
+        threads.emplace_back([&] {
+            std::array<std::uint64_t, batch_size> batch;
+            for (std::size_t sent = 0; sent < per_producer;) {
+                std::size_t pushed;
+                if (batched) {
+                    auto count = std::min(batch_size, per_producer - sent);
+                    for (std::size_t i = 0; i < count; ++i)
+                        batch[i] = sent + i;
+                    pushed = queue.try_push_n(batch.begin(), count);
+                } else {
+                    pushed = queue.try_push(sent);
+                }
+                sent += pushed;
+                if (pushed == 0)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (std::size_t t = 0; t < consumers; ++t) {
+        threads.emplace_back([&, t] {
+            std::array<std::uint64_t, batch_size> batch;
+            for (std::size_t received = 0; received < per_consumer;) {
+                auto wanted = std::min(batched ? batch_size : 1, per_consumer - received);
+                auto popped = queue.try_pop_n(batch.begin(), wanted);
+                for (std::size_t i = 0; i < popped; ++i)
+                    checksums[t] += batch[i];
+                received += popped;
+                if (popped == 0)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    std::uint64_t checksum = 0;
+    for (auto part : checksums)
+        checksum += part;
+    std::cout << name << (batched ? " batched" : "        ") << " " << producers << "P/" << consumers << "C: "
+              << per_producer * producers / std::chrono::duration<double, std::micro>(stop - start).count() << " Mmsg/s"
+              << " (checksum " << checksum << ")\n";
+}
+
+int main() {
+    constexpr std::size_t messages = 4000000;
+
+    for (bool batched : {false, true}) {
+        run<LockedQueue>("  locked vds::Queue", messages, 1, 1, batched);
+        run<vds::SPSCQueue<std::uint64_t>>("  SPSCQueue        ", messages, 1, 1, batched);
+        run<vds::MPMCQueue<std::uint64_t>>("  MPMCQueue        ", messages, 1, 1, batched);
+    }
+
+    auto max_threads = std::thread::hardware_concurrency();
+    for (unsigned thread_count = 4; thread_count <= max_threads; thread_count *= 2) {
+        for (bool batched : {false, true}) {
+            run<LockedQueue>("  locked vds::Queue", messages, thread_count / 2, thread_count / 2, batched);
+            run<vds::MPMCQueue<std::uint64_t>>("  MPMCQueue        ", messages, thread_count / 2, thread_count / 2, batched);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vds/AddressablePriorityQueue.hpp>
+#include <vds/PriorityQueue.hpp>
+#include <vds/TimingWheel.hpp>
+
+// Timeouts as a server sets them: every tick starts a batch of timers with
+// deadlines spread over the next timeout ticks, and most of them are cancelled
+// a little later, before they are due. The rest fire as the clock advances.
+// Compares the timing wheel with PriorityQueue, which cannot remove an item
+// and skips the cancelled ones when they come up instead, and with
+// AddressablePriorityQueue, which erases them.
+
+constexpr std::uint64_t ticks = 200000;
+constexpr std::uint64_t timers_per_tick = 20;
+constexpr std::uint64_t timeout = 30000;
+constexpr std::uint64_t cancel_after = 50;
+constexpr unsigned cancelled_percent = 90;
+
+class WheelTimers {
+public:
+    using Token = vds::TimingWheel<std::uint64_t>::Handle;
+
+    Token schedule(std::uint64_t deadline, std::uint64_t id) {
+        return wheel.schedule(deadline, id);
+    }
+
+    void cancel(Token token) {
+        wheel.cancel(token);
+    }
+
+    template <typename Function>
+    void advance(std::uint64_t now, Function fire) {
+        wheel.advance(now, fire);
+    }
+private:
+    vds::TimingWheel<std::uint64_t> wheel;
+};
+
+class HeapTimers {
+public:
+    using Token = std::uint64_t;
+
+    Token schedule(std::uint64_t deadline, std::uint64_t id) {
+        heap.insert({deadline, id});
+        cancelled.push_back(false);
+        return id;
+    }
+
+    void cancel(Token id) {
+        cancelled[id] = true;
+    }
+
+    template <typename Function>
+    void advance(std::uint64_t now, Function fire) {
+        while (!heap.empty() && heap.min().first <= now) {
+            auto id = heap.min().second;
+            heap.removeMin();
+            if (!cancelled[id])
+                fire(id);
+        }
+    }
+private:
+    vds::PriorityQueue<std::pair<std::uint64_t, std::uint64_t>> heap;
+    std::vector<bool> cancelled;
+};
+
+class AddressableHeapTimers {
+public:
+    using Token = vds::AddressablePriorityQueue<std::pair<std::uint64_t, std::uint64_t>>::Handle;
+
+    Token schedule(std::uint64_t deadline, std::uint64_t id) {
+        return heap.insert({deadline, id});
+    }
+
+    void cancel(Token token) {
+        heap.erase(token);
+    }
+
+    template <typename Function>
+    void advance(std::uint64_t now, Function fire) {
+        while (!heap.empty() && heap.min().first <= now) {
+            auto id = heap.min().second;
+            heap.removeMin();
+            fire(id);
+        }
+    }
+private:
+    vds::AddressablePriorityQueue<std::pair<std::uint64_t, std::uint64_t>> heap;
+};
+
+template <typename Timers>
+void run(const std::string& name) {
+    Timers timers;
+    std::mt19937_64 generator(42);
+    // The timers started cancel_after ticks ago, the ones to cancel marked.
+    std::vector<std::pair<typename Timers::Token, bool>> recent(cancel_after * timers_per_tick);
+    std::uint64_t id = 0;
+    std::uint64_t fired = 0;
+    std::uint64_t checksum = 0;
+    auto fire = [&](std::uint64_t fired_id) {
+        fired++;
+        checksum += fired_id;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t now = 0; now < ticks; ++now) {
+        for (std::uint64_t i = 0; i < timers_per_tick; ++i, ++id) {
+            auto& slot = recent[id % recent.size()];
+            if (id >= recent.size() && slot.second)
+                timers.cancel(slot.first);
+            auto deadline = now + cancel_after + 1 + generator() % timeout;
+            slot = {timers.schedule(deadline, id), generator() % 100 < cancelled_percent};
+        }
+        timers.advance(now, fire);
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    std::cout << name << ": "
+              << std::chrono::duration<double, std::nano>(stop - start).count() / id << " ns/timer"
+              << " (" << fired << " fired, checksum " << checksum << ")\n";
+}
+
+int main() {
+    run<WheelTimers>("  TimingWheel             ");
+    run<HeapTimers>("  PriorityQueue           ");
+    run<AddressableHeapTimers>("  AddressablePriorityQueue");
+}
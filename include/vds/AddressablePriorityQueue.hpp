@@ -0,0 +1,195 @@
+#pragma once
+
+#include "Trace.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace vds {
+
+// A binary min heap whose items can be reached again after insertion: insert
+// hands out a handle, and decrease_key, update and erase take it, each costing
+// a single O(log n) sift. This is what Dijkstra or A* need to relax an edge in
+// place, instead of pushing a duplicate and skipping the stale entry later.
+//
+// Next to the heap of (item, handle) entries, positions maps every live handle
+// to its index in the heap, and is kept up to date whenever an entry moves.
+// Handles of removed items are reused.
+template <typename T, typename Compare = std::less<T>>
+class AddressablePriorityQueue {
+public:
+    using Handle = size_t;
+
+    AddressablePriorityQueue(Compare = Compare());
+    Handle insert(T item);
+    const T& min() const;
+    Handle min_handle() const;
+    void removeMin();
+    bool empty() const;
+    size_t size() const;
+
+    // Whether handle refers to an item still in the queue.
+    bool contains(Handle) const;
+    const T& get(Handle) const;
+    // Replaces the item with one that does not compare greater.
+    void decrease_key(Handle, T item);
+    // Replaces the item with any other.
+    void update(Handle, T item);
+    void erase(Handle);
+private:
+    struct Entry {
+        T item;
+        Handle handle;
+    };
+
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    Compare isLess;
+    std::vector<Entry> heap;
+    // The heap index of a live handle. The entries of free handles instead
+    // chain them into a list starting at free_handle.
+    std::vector<size_t> positions;
+    Handle free_handle{npos};
+
+    Handle _acquire_handle();
+    // Moves the hole at pos up or down until entry fits into it.
+    void _sift_up(size_t pos, Entry entry);
+    void _sift_down(size_t pos, Entry entry);
+    void _place(size_t pos, Entry&& entry);
+    void _remove_at(size_t pos);
+};
+
+template <typename T, typename Compare>
+AddressablePriorityQueue<T, Compare>::AddressablePriorityQueue(Compare isLess)
+: isLess(std::move(isLess)) {}
+
+template <typename T, typename Compare>
+auto AddressablePriorityQueue<T, Compare>::insert(T item) -> Handle {
+    auto handle = _acquire_handle();
+    heap.push_back(Entry{std::move(item), handle});
+    _sift_up(heap.size() - 1, std::move(heap.back()));
+    return handle;
+}
+
+template <typename T, typename Compare>
+const T& AddressablePriorityQueue<T, Compare>::min() const {
+    return heap.front().item;
+}
+
+template <typename T, typename Compare>
+auto AddressablePriorityQueue<T, Compare>::min_handle() const -> Handle {
+    return heap.front().handle;
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::removeMin() {
+    _remove_at(0);
+}
+
+template <typename T, typename Compare>
+bool AddressablePriorityQueue<T, Compare>::empty() const {
+    return heap.empty();
+}
+
+template <typename T, typename Compare>
+size_t AddressablePriorityQueue<T, Compare>::size() const {
+    return heap.size();
+}
+
+template <typename T, typename Compare>
+bool AddressablePriorityQueue<T, Compare>::contains(Handle handle) const {
+    // A free handle's entry may happen to be a valid index, but the entry
+    // there then belongs to another handle.
+    return handle < positions.size()
+        && positions[handle] < heap.size()
+        && heap[positions[handle]].handle == handle;
+}
+
+template <typename T, typename Compare>
+const T& AddressablePriorityQueue<T, Compare>::get(Handle handle) const {
+    return heap[positions[handle]].item;
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::decrease_key(Handle handle, T item) {
+    _sift_up(positions[handle], Entry{std::move(item), handle});
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::update(Handle handle, T item) {
+    auto pos = positions[handle];
+    if (pos > 0 && isLess(item, heap[(pos - 1) / 2].item)) {
+        _sift_up(pos, Entry{std::move(item), handle});
+    } else {
+        _sift_down(pos, Entry{std::move(item), handle});
+    }
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::erase(Handle handle) {
+    _remove_at(positions[handle]);
+}
+
+template <typename T, typename Compare>
+auto AddressablePriorityQueue<T, Compare>::_acquire_handle() -> Handle {
+    if (free_handle == npos) {
+        positions.push_back(npos);
+        return positions.size() - 1;
+    }
+    auto handle = free_handle;
+    free_handle = positions[handle];
+    return handle;
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::_sift_up(size_t pos, Entry entry) {
+    while (pos > 0 && isLess(entry.item, heap[(pos - 1) / 2].item)) {
+        VDS_TRACE(SiftStep, 1);
+        _place(pos, std::move(heap[(pos - 1) / 2]));
+        pos = (pos - 1) / 2;
+    }
+    _place(pos, std::move(entry));
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::_sift_down(size_t pos, Entry entry) {
+    while (2 * pos + 1 < heap.size()) {
+        auto child = 2 * pos + 1;
+        if (child + 1 < heap.size() && isLess(heap[child + 1].item, heap[child].item))
+            child++;
+        if (!isLess(heap[child].item, entry.item))
+            break;
+        VDS_TRACE(SiftStep, 1);
+        _place(pos, std::move(heap[child]));
+        pos = child;
+    }
+    _place(pos, std::move(entry));
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::_place(size_t pos, Entry&& entry) {
+    heap[pos] = std::move(entry);
+    positions[heap[pos].handle] = pos;
+}
+
+template <typename T, typename Compare>
+void AddressablePriorityQueue<T, Compare>::_remove_at(size_t pos) {
+    auto handle = heap[pos].handle;
+    positions[handle] = free_handle;
+    free_handle = handle;
+
+    auto last = std::move(heap.back());
+    heap.pop_back();
+    if (pos == heap.size())
+        return;
+    if (pos > 0 && isLess(last.item, heap[(pos - 1) / 2].item)) {
+        _sift_up(pos, std::move(last));
+    } else {
+        _sift_down(pos, std::move(last));
+    }
+}
+
+} // namespace vds
@@ -1,7 +1,7 @@
 #pragma once
 
+#include <memory>
 #include <utility>
-#include <iostream>
 
 namespace vds {
 template <typename T>
@@ -10,9 +10,12 @@ struct CLNode {
     CLNode* next;
 };
 
-template <typename T>
+template <typename T, typename Allocator = std::allocator<T>>
 class CLList {
 public:
+    using AllocatorType = Allocator;
+
+    CLList(const Allocator& = Allocator());
     ~CLList();
     bool empty() const;
     const T& front() const;
@@ -20,59 +23,94 @@ public:
     void add(T element);
     void remove();
     void advance();
+    Allocator get_allocator() const;
 private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<CLNode<T>>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    NodeAllocator allocator;
     CLNode<T>* cursor = nullptr;
+
+    CLNode<T>* _create_node(T element, CLNode<T>* next);
+    void _destroy_node(CLNode<T>*);
 };
 
-template <typename T>
-CLList<T>::~CLList() {
+template <typename T, typename Allocator>
+CLList<T, Allocator>::CLList(const Allocator& allocator)
+: allocator(allocator) {}
+
+template <typename T, typename Allocator>
+CLList<T, Allocator>::~CLList() {
     while (!empty()) {
         remove();
     }
 }
 
-template <typename T>
-bool CLList<T>::empty() const {
+template <typename T, typename Allocator>
+bool CLList<T, Allocator>::empty() const {
     return cursor == nullptr;
 }
 
-template <typename T>
-const T& CLList<T>::front() const {
+template <typename T, typename Allocator>
+const T& CLList<T, Allocator>::front() const {
     return cursor->next->element;
 }
 
-template <typename T>
-const T& CLList<T>::back() const {
+template <typename T, typename Allocator>
+const T& CLList<T, Allocator>::back() const {
     return cursor->element;
 }
 
-template <typename T>
-void CLList<T>::add(T element) {
+template <typename T, typename Allocator>
+void CLList<T, Allocator>::add(T element) {
     if (!cursor) {
-        cursor = new CLNode<T>{std::move(element), nullptr};
+        cursor = _create_node(std::move(element), nullptr);
         cursor->next = cursor;
         return;
     }
     auto current_after_cursor = cursor->next;
-    auto new_node = new CLNode<T>{std::move(element), current_after_cursor};
+    auto new_node = _create_node(std::move(element), current_after_cursor);
     cursor->next = new_node;
 }
 
-template <typename T>
-void CLList<T>::remove() {
+template <typename T, typename Allocator>
+void CLList<T, Allocator>::remove() {
     if (cursor == cursor->next) {
-        delete cursor;
+        _destroy_node(cursor);
         cursor = nullptr;
         return;
     }
     auto current_front = cursor->next;
     cursor->next = cursor->next->next;
-    delete current_front;
+    _destroy_node(current_front);
 }
 
-template <typename T>
-void CLList<T>::advance() {
+template <typename T, typename Allocator>
+void CLList<T, Allocator>::advance() {
     cursor = cursor->next;
 }
 
+template <typename T, typename Allocator>
+Allocator CLList<T, Allocator>::get_allocator() const {
+    return Allocator(allocator);
+}
+
+template <typename T, typename Allocator>
+CLNode<T>* CLList<T, Allocator>::_create_node(T element, CLNode<T>* next) {
+    auto node = NodeTraits::allocate(allocator, 1);
+    try {
+        ::new (static_cast<void*>(node)) CLNode<T>{std::move(element), next};
+    } catch (...) {
+        NodeTraits::deallocate(allocator, node, 1);
+        throw;
+    }
+    return node;
+}
+
+template <typename T, typename Allocator>
+void CLList<T, Allocator>::_destroy_node(CLNode<T>* node) {
+    node->~CLNode<T>();
+    NodeTraits::deallocate(allocator, node, 1);
+}
+
 } // namespace vds
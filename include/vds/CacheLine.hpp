@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+namespace vds {
+
+// Assumed size of a cache line, used to keep data written by different threads
+// on separate lines. std::hardware_destructive_interference_size would be the
+// standard spelling, but not every standard library we build with provides it.
+inline constexpr std::size_t cache_line_size = 64;
+
+} // namespace vds
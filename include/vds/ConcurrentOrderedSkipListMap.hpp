@@ -0,0 +1,477 @@
+#pragma once
+
+#include "CacheLine.hpp"
+#include "EpochDomain.hpp"
+#include "SkipListLevelGenerator.hpp"
+#include "Trace.hpp"
+#include "TypeTraits.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace vds {
+
+// Like SkipListNode, one allocation holds the entry and the tower of forward
+// links. A link is a node pointer whose lowest bit marks the node owning the
+// link as logically deleted, which freezes the link.
+template <typename Key, typename Value>
+struct ConcurrentSkipListNode {
+    using Entry = std::pair<Key, Value>;
+    using Link = std::atomic<std::uintptr_t>;
+
+    ConcurrentSkipListNode(std::size_t height, Key key, Value value)
+    : entry(std::move(key), std::move(value))
+    , height(height) {}
+
+    Entry entry;
+    std::size_t height;
+    // Held by the inserting thread until it is done linking the upper levels
+    // and by the thread that erases the node. Whichever lets go last makes
+    // sure the node is unlinked everywhere and retires it.
+    std::atomic<unsigned> owners{2};
+
+    Link* next();
+
+    const Key& key() const;
+
+    static ConcurrentSkipListNode* create(std::size_t height, Key key, Value value);
+    static void destroy(void*);
+};
+
+template <typename Key, typename Value>
+auto ConcurrentSkipListNode<Key, Value>::next() -> Link* {
+    return std::launder(reinterpret_cast<Link*>(this + 1));
+}
+
+template <typename Key, typename Value>
+auto ConcurrentSkipListNode<Key, Value>::key() const -> const Key& {
+    return entry.first;
+}
+
+template <typename Key, typename Value>
+auto ConcurrentSkipListNode<Key, Value>::create(std::size_t height, Key key, Value value) -> ConcurrentSkipListNode* {
+    void* memory = ::operator new(sizeof(ConcurrentSkipListNode) + height * sizeof(Link));
+    auto node = new (memory) ConcurrentSkipListNode(height, std::move(key), std::move(value));
+    auto links = reinterpret_cast<Link*>(node + 1);
+    for (std::size_t level = 0; level < height; ++level) {
+        new (links + level) Link(0);
+    }
+    return node;
+}
+
+template <typename Key, typename Value>
+auto ConcurrentSkipListNode<Key, Value>::destroy(void* pointer) -> void {
+    // The links are trivially destructible.
+    auto node = static_cast<ConcurrentSkipListNode*>(pointer);
+    node->~ConcurrentSkipListNode();
+    ::operator delete(node);
+}
+
+
+// Lock-free ordered map (Herlihy and Shavit's skip list, after Fraser). insert,
+// find and erase may run concurrently from any number of threads. A node is
+// erased by first marking its links, top level down, then unlinking it;
+// searches help by unlinking marked nodes they walk past. Unlinked nodes are
+// reclaimed through the global EpochDomain.
+//
+// Iteration is weakly consistent: it sees every entry that is present for the
+// whole walk, and may or may not see entries inserted or erased meanwhile.
+// Values are handed out by reference and are not synchronized, writing to them
+// from several threads needs synchronization of its own.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class ConcurrentOrderedSkipListMap {
+public:
+    using Node = ConcurrentSkipListNode<Key, Value>;
+    using Entry = typename Node::Entry;
+
+    static constexpr std::size_t max_level = 32;
+
+    // Keeps the calling thread pinned, so the entry it points to stays alive
+    // even if it is erased. It must not be handed to another thread.
+    class Iterator {
+    public:
+        friend class ConcurrentOrderedSkipListMap;
+
+        Entry& operator*();
+        Entry* operator->();
+        bool operator==(const Iterator&) const;
+        bool operator!=(const Iterator&) const;
+        Iterator& operator++();
+        Iterator operator++(int);
+    private:
+        Iterator(Node*, EpochDomain::Guard);
+        Node* current;
+        EpochDomain::Guard guard;
+    };
+
+    // Only the promotion probability and the max level of the generator are
+    // used, each thread draws its random words from a generator of its own.
+    ConcurrentOrderedSkipListMap(Compare = Compare(), SkipListLevelGenerator = SkipListLevelGenerator());
+    ConcurrentOrderedSkipListMap(const ConcurrentOrderedSkipListMap&) = delete;
+    ConcurrentOrderedSkipListMap& operator=(const ConcurrentOrderedSkipListMap&) = delete;
+    // Must not race with any other operation.
+    ~ConcurrentOrderedSkipListMap();
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    // Only exact while no other thread modifies the map.
+    std::size_t size() const;
+    bool empty() const;
+    Iterator find(const Key&) const;
+    // Returns false, leaving the map unchanged, if the key is already present.
+    bool insert(Key, Value);
+    // Returns false if the key was not present.
+    bool erase(const Key&);
+    std::size_t count(const Key&) const;
+
+    // Heterogeneous lookup, available when Compare declares is_transparent.
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator find(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    bool erase(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    std::size_t count(const K&) const;
+private:
+    using Link = typename Node::Link;
+    using Window = std::array<Node*, max_level>;
+
+    Compare less;
+    SkipListLevelGenerator levels;
+    // Forward links of the head of the list. Wherever a predecessor is
+    // expected, nullptr stands for the head.
+    mutable std::array<Link, max_level> head{};
+    alignas(cache_line_size) std::atomic<std::size_t> element_count{0};
+
+    static bool _is_marked(std::uintptr_t link);
+    static Node* _node(std::uintptr_t link);
+    static std::uintptr_t _link(Node*);
+    std::size_t _random_height() const;
+
+    Link* _links(Node*) const;
+    static Node* _first_unmarked(Node*);
+    template <typename K>
+    bool _try_find(const K& key, Node** predecessors, Node** successors) const;
+    template <typename K>
+    bool _find(const K& key, Node** predecessors, Node** successors) const;
+    template <typename K>
+    Node* _find_node(const K& key) const;
+    template <typename K>
+    bool _erase(const K& key);
+    void _release(Node*);
+};
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentOrderedSkipListMap<Key, Value, Compare>::Iterator::Iterator(Node* current, EpochDomain::Guard guard)
+: current{current}
+, guard{std::move(guard)} {}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::Iterator::operator*() -> Entry& {
+    return current->entry;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::Iterator::operator->() -> Entry* {
+    return &current->entry;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::Iterator::operator==(const Iterator& other) const -> bool {
+    return current == other.current;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::Iterator::operator!=(const Iterator& other) const -> bool {
+    return !(*this == other);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::Iterator::operator++() -> Iterator& {
+    current = _first_unmarked(_node(current->next()[0].load(std::memory_order_acquire)));
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::Iterator::operator++(int) -> Iterator {
+    Iterator prev(*this);
+    ++*this;
+    return prev;
+}
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentOrderedSkipListMap<Key, Value, Compare>::ConcurrentOrderedSkipListMap(Compare compare, SkipListLevelGenerator levels)
+: less(std::move(compare))
+, levels(levels) {}
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentOrderedSkipListMap<Key, Value, Compare>::~ConcurrentOrderedSkipListMap() {
+    // Erased nodes have all been unlinked by the time erase returned, so the
+    // bottom level holds exactly the nodes still owned by the map.
+    auto node = _node(head[0].load(std::memory_order_acquire));
+    while (node) {
+        auto next = _node(node->next()[0].load(std::memory_order_relaxed));
+        Node::destroy(node);
+        node = next;
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_is_marked(std::uintptr_t link) -> bool {
+    return link & 1;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_node(std::uintptr_t link) -> Node* {
+    return reinterpret_cast<Node*>(link & ~std::uintptr_t{1});
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_link(Node* node) -> std::uintptr_t {
+    return reinterpret_cast<std::uintptr_t>(node);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_random_height() const -> std::size_t {
+    // One generator per thread, so that inserts share no state.
+    static thread_local SkipListLevelGenerator generator(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    return std::min(levels.height(generator.random()), max_level);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_links(Node* node) const -> Link* {
+    return node ? node->next() : head.data();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_first_unmarked(Node* node) -> Node* {
+    while (node) {
+        auto next = node->next()[0].load(std::memory_order_acquire);
+        if (not _is_marked(next))
+            break;
+        node = _node(next);
+    }
+    return node;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_try_find(const K& key, Node** predecessors, Node** successors) const -> bool {
+    // Same walk as OrderedSkipListMap::_find_after, except that marked nodes
+    // are unlinked on the way. When that fails, the predecessor changed under
+    // us and the search has to start over.
+    Node* predecessor = nullptr;
+    for (std::size_t level = max_level; level-- > 0;) {
+        auto current = _node(_links(predecessor)[level].load(std::memory_order_acquire));
+        while (current) {
+            auto next = current->next()[level].load(std::memory_order_acquire);
+            if (_is_marked(next)) {
+                auto expected = _link(current);
+                if (not _links(predecessor)[level].compare_exchange_strong(
+                        expected, next & ~std::uintptr_t{1}, std::memory_order_acq_rel, std::memory_order_acquire))
+                    return false;
+                current = _node(next);
+            } else if (less(current->key(), key)) {
+                predecessor = current;
+                current = _node(next);
+            } else {
+                break;
+            }
+        }
+        predecessors[level] = predecessor;
+        successors[level] = current;
+    }
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_find(const K& key, Node** predecessors, Node** successors) const -> bool {
+    while (not _try_find(key, predecessors, successors)) {}
+    return successors[0] and not less(key, successors[0]->key());
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_find_node(const K& key) const -> Node* {
+    // Lookups only skip over marked nodes, so they never write to shared
+    // memory and never restart.
+    Node* predecessor = nullptr;
+    Node* current = nullptr;
+    for (std::size_t level = max_level; level-- > 0;) {
+        current = _node(_links(predecessor)[level].load(std::memory_order_acquire));
+        while (current) {
+            auto next = current->next()[level].load(std::memory_order_acquire);
+            if (_is_marked(next)) {
+                current = _node(next);
+            } else if (less(current->key(), key)) {
+                predecessor = current;
+                current = _node(next);
+            } else {
+                break;
+            }
+        }
+    }
+    return current and not less(key, current->key()) ? current : nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::begin() const -> Iterator {
+    auto guard = EpochDomain::global().pin();
+    auto first = _first_unmarked(_node(head[0].load(std::memory_order_acquire)));
+    return Iterator(first, std::move(guard));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::end() const -> Iterator {
+    return Iterator(nullptr, EpochDomain::Guard());
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::size() const -> std::size_t {
+    return element_count.load(std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::empty() const -> bool {
+    return size() == 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::find(const Key& key) const -> Iterator {
+    auto guard = EpochDomain::global().pin();
+    auto node = _find_node(key);
+    return node ? Iterator(node, std::move(guard)) : end();
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::find(const K& key) const -> Iterator {
+    auto guard = EpochDomain::global().pin();
+    auto node = _find_node(key);
+    return node ? Iterator(node, std::move(guard)) : end();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::count(const Key& key) const -> std::size_t {
+    auto guard = EpochDomain::global().pin();
+    return _find_node(key) != nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::count(const K& key) const -> std::size_t {
+    auto guard = EpochDomain::global().pin();
+    return _find_node(key) != nullptr;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::insert(Key key, Value value) -> bool {
+    auto guard = EpochDomain::global().pin();
+    Window predecessors, successors;
+    if (_find(key, predecessors.data(), successors.data()))
+        return false;
+
+    auto height = _random_height();
+    VDS_TRACE(TowerHeight, height);
+    auto node = Node::create(height, std::move(key), std::move(value));
+
+    // The node is published by linking it into the bottom level.
+    while (true) {
+        for (std::size_t level = 0; level < height; ++level) {
+            node->next()[level].store(_link(successors[level]), std::memory_order_relaxed);
+        }
+        auto expected = _link(successors[0]);
+        if (_links(predecessors[0])[0].compare_exchange_strong(
+                expected, _link(node), std::memory_order_release, std::memory_order_relaxed))
+            break;
+        if (_find(node->key(), predecessors.data(), successors.data())) {
+            Node::destroy(node);
+            return false;
+        }
+    }
+    element_count.fetch_add(1, std::memory_order_relaxed);
+
+    // The upper levels are only shortcuts. Once the node is marked, linking
+    // it any further is pointless, and erase takes care of what is there.
+    for (std::size_t level = 1; level < height; ++level) {
+        bool linked = false;
+        while (not linked) {
+            auto next = node->next()[level].load(std::memory_order_acquire);
+            if (_is_marked(next))
+                break;
+            if (next != _link(successors[level])
+                and not node->next()[level].compare_exchange_strong(next, _link(successors[level]), std::memory_order_release))
+                continue;
+
+            auto expected = _link(successors[level]);
+            linked = _links(predecessors[level])[level].compare_exchange_strong(
+                expected, _link(node), std::memory_order_release, std::memory_order_relaxed);
+            if (not linked) {
+                _find(node->key(), predecessors.data(), successors.data());
+                if (successors[0] != node)
+                    break;
+            }
+        }
+        if (not linked)
+            break;
+    }
+
+    _release(node);
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_erase(const K& key) -> bool {
+    auto guard = EpochDomain::global().pin();
+    Window predecessors, successors;
+    if (not _find(key, predecessors.data(), successors.data()))
+        return false;
+
+    auto node = successors[0];
+    for (std::size_t level = node->height; level-- > 1;) {
+        node->next()[level].fetch_or(1, std::memory_order_acq_rel);
+    }
+    // Marking the bottom level is what erases the entry. If another thread
+    // got there first, the key was erased by that thread.
+    if (_is_marked(node->next()[0].fetch_or(1, std::memory_order_acq_rel)))
+        return false;
+
+    element_count.fetch_sub(1, std::memory_order_relaxed);
+    _release(node);
+    return true;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::erase(const Key& key) -> bool {
+    return _erase(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::erase(const K& key) -> bool {
+    return _erase(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto ConcurrentOrderedSkipListMap<Key, Value, Compare>::_release(Node* node) -> void {
+    if (_is_marked(node->next()[0].load(std::memory_order_acquire))) {
+        // A search unlinks every marked node on its path, and a node with the
+        // searched key is on the path at every level it is linked into.
+        Window predecessors, successors;
+        _find(node->key(), predecessors.data(), successors.data());
+    }
+    if (node->owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        EpochDomain::global().retire(node, &Node::destroy);
+}
+
+} // namespace vds
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <memory>
+
 namespace vds {
-template <typename T>
+template <typename T, typename Allocator>
 class DLList;
 
 template <typename T>
@@ -12,10 +14,12 @@ public:
     DLNode* previous;
 };
 
-template <typename T>
+template <typename T, typename Allocator = std::allocator<T>>
 class DLList {
 public:
-    DLList();
+    using AllocatorType = Allocator;
+
+    DLList(const Allocator& = Allocator());
     ~DLList();
     bool empty() const;
     const T& front() const;
@@ -24,18 +28,32 @@ public:
     void push_back(const T& element);
     void remove_front();
     void remove_back();
+    Allocator get_allocator() const;
 private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<DLNode<T>>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    NodeAllocator allocator;
     DLNode<T>* head;
     DLNode<T>* tail;
+
+    DLNode<T>* _create_node();
+    void _destroy_node(DLNode<T>*);
 protected:
     void add(DLNode<T>* node, const T& element);
     void remove(DLNode<T>* node);
 };
 
-template <typename T>
-DLList<T>::DLList() {
-    head = new DLNode<T>;
-    tail = new DLNode<T>;
+template <typename T, typename Allocator>
+DLList<T, Allocator>::DLList(const Allocator& allocator)
+: allocator(allocator) {
+    head = _create_node();
+    try {
+        tail = _create_node();
+    } catch (...) {
+        _destroy_node(head);
+        throw;
+    }
 
     head->previous = nullptr;
     head->next = tail;
@@ -44,32 +62,37 @@ DLList<T>::DLList() {
     tail->next = nullptr;
 }
 
-template <typename T>
-DLList<T>::~DLList() {
+template <typename T, typename Allocator>
+DLList<T, Allocator>::~DLList() {
     while(!empty()) remove_front();
-    delete head;
-    delete tail;
+    _destroy_node(head);
+    _destroy_node(tail);
 }
 
-template <typename T>
-bool DLList<T>::empty() const {
+template <typename T, typename Allocator>
+bool DLList<T, Allocator>::empty() const {
     return head->next == tail; 
 }
 
-template <typename T>
-const T& DLList<T>::front() const {
+template <typename T, typename Allocator>
+const T& DLList<T, Allocator>::front() const {
     return head->next->element;
 }
 
-template <typename T>
-const T& DLList<T>::back() const {
+template <typename T, typename Allocator>
+const T& DLList<T, Allocator>::back() const {
     return tail->previous->element;
 }
 
-template <typename T>
-void DLList<T>::add(DLNode<T>* node, const T& element) {
-    DLNode<T>* new_node = new DLNode<T>;
-    new_node->element = element;
+template <typename T, typename Allocator>
+void DLList<T, Allocator>::add(DLNode<T>* node, const T& element) {
+    DLNode<T>* new_node = _create_node();
+    try {
+        new_node->element = element;
+    } catch (...) {
+        _destroy_node(new_node);
+        throw;
+    }
     new_node->next = node->next;
     new_node->previous = node;
 
@@ -77,37 +100,60 @@ void DLList<T>::add(DLNode<T>* node, const T& element) {
     node->next = new_node;
 }
 
-template <typename T>
-void DLList<T>::push_back(const T& element) {
+template <typename T, typename Allocator>
+void DLList<T, Allocator>::push_back(const T& element) {
     add(head, element);
 }
 
-template <typename T>
-void DLList<T>::push_front(const T& element) {
+template <typename T, typename Allocator>
+void DLList<T, Allocator>::push_front(const T& element) {
     add(tail->previous, element);
 }
 
-template <typename T>
-void DLList<T>::remove(DLNode<T>* node) {
+template <typename T, typename Allocator>
+void DLList<T, Allocator>::remove(DLNode<T>* node) {
     node->next->previous = node->previous;
     node->previous->next = node->next;
-    delete node;
+    _destroy_node(node);
 }
 
-template <typename T>
-void DLList<T>::remove_front() {
+template <typename T, typename Allocator>
+void DLList<T, Allocator>::remove_front() {
     DLNode<T>* node_to_remove = head->next;
     head->next = head->next->next;
     head->next->previous = head;
-    delete node_to_remove; 
+    _destroy_node(node_to_remove); 
 }
 
-template <typename T>
-void DLList<T>::remove_back() {
+template <typename T, typename Allocator>
+void DLList<T, Allocator>::remove_back() {
     DLNode<T>* node_to_remove = tail->previous;
     tail->previous = tail->previous->previous;
     tail->previous->next = tail;
-    delete node_to_remove;
+    _destroy_node(node_to_remove);
+}
+
+template <typename T, typename Allocator>
+Allocator DLList<T, Allocator>::get_allocator() const {
+    return Allocator(allocator);
+}
+
+template <typename T, typename Allocator>
+DLNode<T>* DLList<T, Allocator>::_create_node() {
+    auto node = NodeTraits::allocate(allocator, 1);
+    try {
+        ::new (static_cast<void*>(node)) DLNode<T>();
+    } catch (...) {
+        NodeTraits::deallocate(allocator, node, 1);
+        throw;
+    }
+    return node;
 }
 
-}
\ No newline at end of file
+template <typename T, typename Allocator>
+void DLList<T, Allocator>::_destroy_node(DLNode<T>* node) {
+    node->~DLNode<T>();
+    NodeTraits::deallocate(allocator, node, 1);
+}
+
+}
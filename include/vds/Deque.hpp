@@ -1,71 +1,344 @@
 #pragma once
 
-#include "DLList.hpp"
-#include <utility>
+#include <algorithm>
 #include <cstddef>
+#include <memory>
+#include <utility>
 
 namespace vds {
 
-template <typename T>
+template <typename T, typename Allocator>
+class Deque;
+
+template <typename T, typename Allocator>
+void swap(Deque<T, Allocator>&, Deque<T, Allocator>&);
+
+// A segmented double ended queue, laid out like std::deque: the elements sit in
+// fixed size blocks, and a map of block pointers keeps the blocks in order.
+// Element i lives at offset first + i counted from the start of the first map
+// entry, which gives constant time indexing, and growing at either end never
+// moves an element, only block pointers when the map has to be recentred or
+// grown.
+//
+// Only the blocks holding elements are allocated, except that an empty deque
+// keeps its last block, so a deque that keeps filling up and draining again
+// does not allocate each time.
+template <typename T, typename Allocator = std::allocator<T>>
 class Deque {
 public:
     using SizeType = size_t;
+    using AllocatorType = Allocator;
+
+    static constexpr SizeType block_size = sizeof(T) < 256 ? 4096 / sizeof(T) : 16;
+
+    Deque(const Allocator& = Allocator());
+    Deque(const Deque&);
+    Deque(Deque&&);
+    ~Deque();
+    Deque& operator=(const Deque&);
+    Deque& operator=(Deque&&);
+
     void insert_front(T);
     void insert_back(T);
     void erase_front();
     void erase_back();
     const T& front() const;
     const T& back() const;
+    T& operator[](SizeType);
+    const T& operator[](SizeType) const;
     SizeType size() const;
     bool empty() const;
+    void clear();
+    Allocator get_allocator() const;
+
+    friend void swap<T, Allocator>(Deque&, Deque&);
 private:
-    SizeType sz;
-    DLList<T> list;
+    using Traits = std::allocator_traits<Allocator>;
+    using MapAllocator = typename Traits::template rebind_alloc<T*>;
+    using MapTraits = std::allocator_traits<MapAllocator>;
+
+    static constexpr SizeType min_map_size = 8;
+
+    Allocator allocator;
+    T** map{nullptr};
+    SizeType map_size{0};
+    // The allocated blocks are map[block_begin, block_end).
+    SizeType block_begin{0};
+    SizeType block_end{0};
+    SizeType first{0};
+    SizeType sz{0};
+
+    T* _slot(SizeType offset) const;
+    // Makes sure there is a free map entry before block_begin, or after
+    // block_end, recentring the blocks in the map or moving them to a bigger
+    // one.
+    void _make_map_room(bool at_front);
+    // Gives an empty deque a block, with first in its middle.
+    void _start();
+    void _release();
+    void _append(const Deque& other);
 };
 
-template <typename T>
-void Deque<T>::insert_front(T element) {
+template <typename T, typename Allocator>
+void swap(Deque<T, Allocator>& lhs, Deque<T, Allocator>& rhs) {
+    using std::swap;
+    if constexpr (Deque<T, Allocator>::Traits::propagate_on_container_swap::value)
+        swap(lhs.allocator, rhs.allocator);
+    swap(lhs.map, rhs.map);
+    swap(lhs.map_size, rhs.map_size);
+    swap(lhs.block_begin, rhs.block_begin);
+    swap(lhs.block_end, rhs.block_end);
+    swap(lhs.first, rhs.first);
+    swap(lhs.sz, rhs.sz);
+}
+
+template <typename T, typename Allocator>
+Deque<T, Allocator>::Deque(const Allocator& allocator)
+: allocator(allocator) {}
+
+template <typename T, typename Allocator>
+Deque<T, Allocator>::Deque(const Deque& other)
+: allocator(Traits::select_on_container_copy_construction(other.allocator)) {
+    _append(other);
+}
+
+template <typename T, typename Allocator>
+Deque<T, Allocator>::Deque(Deque&& other)
+: allocator(other.allocator)
+, map(std::exchange(other.map, nullptr))
+, map_size(std::exchange(other.map_size, 0))
+, block_begin(std::exchange(other.block_begin, 0))
+, block_end(std::exchange(other.block_end, 0))
+, first(std::exchange(other.first, 0))
+, sz(std::exchange(other.sz, 0))
+{}
+
+template <typename T, typename Allocator>
+Deque<T, Allocator>::~Deque() {
+    _release();
+}
+
+template <typename T, typename Allocator>
+auto Deque<T, Allocator>::operator=(const Deque& other) -> Deque& {
+    if (this != &other) {
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            if (allocator != other.allocator)
+                _release();
+            allocator = other.allocator;
+        }
+        clear();
+        _append(other);
+    }
+    return *this;
+}
+
+template <typename T, typename Allocator>
+auto Deque<T, Allocator>::operator=(Deque&& other) -> Deque& {
+    if (this == &other)
+        return *this;
+    if (Traits::propagate_on_container_move_assignment::value or allocator == other.allocator) {
+        _release();
+        if constexpr (Traits::propagate_on_container_move_assignment::value)
+            allocator = other.allocator;
+        map = std::exchange(other.map, nullptr);
+        map_size = std::exchange(other.map_size, 0);
+        block_begin = std::exchange(other.block_begin, 0);
+        block_end = std::exchange(other.block_end, 0);
+        first = std::exchange(other.first, 0);
+        sz = std::exchange(other.sz, 0);
+    } else {
+        // The blocks cannot change hands between allocators that differ.
+        clear();
+        for (SizeType i = 0; i < other.sz; ++i) {
+            insert_back(std::move(other[i]));
+        }
+        other.clear();
+    }
+    return *this;
+}
+
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::insert_front(T element) {
+    if (block_begin == block_end)
+        _start();
+    if (first == block_begin * block_size) {
+        if (block_begin == 0)
+            _make_map_room(true);
+        // The block is only counted in once the element is in, in case
+        // constructing it throws.
+        map[block_begin - 1] = Traits::allocate(allocator, block_size);
+        try {
+            Traits::construct(allocator, map[block_begin - 1] + block_size - 1, std::move(element));
+        } catch (...) {
+            Traits::deallocate(allocator, map[block_begin - 1], block_size);
+            throw;
+        }
+        block_begin--;
+    } else {
+        Traits::construct(allocator, _slot(first - 1), std::move(element));
+    }
+    first--;
     sz++;
-    list.push_front(std::move(element));
 }
 
-template <typename T>
-void Deque<T>::insert_back(T element) {
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::insert_back(T element) {
+    if (block_begin == block_end)
+        _start();
+    if (first + sz == block_end * block_size) {
+        if (block_end == map_size)
+            _make_map_room(false);
+        map[block_end] = Traits::allocate(allocator, block_size);
+        try {
+            Traits::construct(allocator, map[block_end], std::move(element));
+        } catch (...) {
+            Traits::deallocate(allocator, map[block_end], block_size);
+            throw;
+        }
+        block_end++;
+    } else {
+        Traits::construct(allocator, _slot(first + sz), std::move(element));
+    }
     sz++;
-    list.push_back(std::move(element));
 }
 
-template <typename T>
-void Deque<T>::erase_front() {
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::erase_front() {
+    Traits::destroy(allocator, _slot(first));
+    first++;
     sz--;
-    list.remove_front();
+    if (sz == 0) {
+        first = block_begin * block_size + block_size / 2;
+    } else if (first % block_size == 0) {
+        Traits::deallocate(allocator, map[block_begin], block_size);
+        block_begin++;
+    }
 }
 
-template <typename T>
-void Deque<T>::erase_back() {
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::erase_back() {
     sz--;
-    list.remove_back();
+    Traits::destroy(allocator, _slot(first + sz));
+    if (sz == 0) {
+        first = block_begin * block_size + block_size / 2;
+    } else if ((first + sz) % block_size == 0) {
+        block_end--;
+        Traits::deallocate(allocator, map[block_end], block_size);
+    }
+}
+
+template <typename T, typename Allocator>
+const T& Deque<T, Allocator>::front() const {
+    return *_slot(first);
 }
 
-template <typename T>
-const T& Deque<T>::front() const {
-    return list.front();
+template <typename T, typename Allocator>
+const T& Deque<T, Allocator>::back() const {
+    return *_slot(first + sz - 1);
 }
 
-template <typename T>
-const T& Deque<T>::back() const {
-    return list.back();
+template <typename T, typename Allocator>
+T& Deque<T, Allocator>::operator[](SizeType i) {
+    return *_slot(first + i);
 }
 
-template <typename T>
-auto Deque<T>::size() const -> SizeType {
+template <typename T, typename Allocator>
+const T& Deque<T, Allocator>::operator[](SizeType i) const {
+    return *_slot(first + i);
+}
+
+template <typename T, typename Allocator>
+auto Deque<T, Allocator>::size() const -> SizeType {
     return sz;
 }
 
-template <typename T>
-bool Deque<T>::empty() const {
-    return list.empty();
+template <typename T, typename Allocator>
+bool Deque<T, Allocator>::empty() const {
+    return sz == 0;
+}
+
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::clear() {
+    while (!empty()) {
+        erase_back();
+    }
+}
+
+template <typename T, typename Allocator>
+Allocator Deque<T, Allocator>::get_allocator() const {
+    return allocator;
+}
+
+template <typename T, typename Allocator>
+auto Deque<T, Allocator>::_slot(SizeType offset) const -> T* {
+    return map[offset / block_size] + offset % block_size;
+}
+
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::_make_map_room(bool at_front) {
+    auto blocks = block_end - block_begin;
+    // Half of the spare entries go on each side, and the side that is out of
+    // room gets the odd one.
+    auto spare = map_size - blocks;
+    T** new_map = map;
+    if (spare < blocks + 2) {
+        // Doubling the map keeps recentring amortized constant per block.
+        MapAllocator map_allocator(allocator);
+        auto new_map_size = std::max(2 * map_size, min_map_size);
+        while (new_map_size - blocks < blocks + 2) {
+            new_map_size *= 2;
+        }
+        new_map = MapTraits::allocate(map_allocator, new_map_size);
+        spare = new_map_size - blocks;
+        std::copy(map + block_begin, map + block_end, new_map + (spare + at_front) / 2);
+        if (map != nullptr)
+            MapTraits::deallocate(map_allocator, map, map_size);
+        map_size = new_map_size;
+    } else if ((spare + at_front) / 2 < block_begin) {
+        std::copy(map + block_begin, map + block_end, map + (spare + at_front) / 2);
+    } else {
+        std::copy_backward(map + block_begin, map + block_end, map + (spare + at_front) / 2 + blocks);
+    }
+    map = new_map;
+    auto new_begin = (spare + at_front) / 2;
+    first = first - block_begin * block_size + new_begin * block_size;
+    block_begin = new_begin;
+    block_end = new_begin + blocks;
 }
 
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::_start() {
+    if (map == nullptr) {
+        MapAllocator map_allocator(allocator);
+        map = MapTraits::allocate(map_allocator, min_map_size);
+        map_size = min_map_size;
+    }
+    auto block = Traits::allocate(allocator, block_size);
+    block_begin = map_size / 2;
+    block_end = block_begin + 1;
+    map[block_begin] = block;
+    first = block_begin * block_size + block_size / 2;
+}
+
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::_release() {
+    clear();
+    for (auto block = block_begin; block != block_end; ++block) {
+        Traits::deallocate(allocator, map[block], block_size);
+    }
+    if (map != nullptr) {
+        MapAllocator map_allocator(allocator);
+        MapTraits::deallocate(map_allocator, map, map_size);
+    }
+    map = nullptr;
+    map_size = block_begin = block_end = first = 0;
+}
+
+template <typename T, typename Allocator>
+void Deque<T, Allocator>::_append(const Deque& other) {
+    for (SizeType i = 0; i < other.sz; ++i) {
+        insert_back(other[i]);
+    }
+}
 
-};
\ No newline at end of file
+} // namespace vds
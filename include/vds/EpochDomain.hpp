@@ -0,0 +1,231 @@
+#pragma once
+
+#include "CacheLine.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace vds {
+
+// Epoch based memory reclamation for the lock-free containers. A thread pins
+// the domain while it may hold pointers into a shared structure. Memory that
+// has been unlinked from the structure is retired rather than freed, and only
+// freed once the global epoch has moved two steps past the retirement: at that
+// point every thread that was pinned when the memory was unlinked has unpinned.
+//
+// There is a single process-wide domain, each thread registers itself on first
+// use and leaves what it could not free yet to the domain when it exits.
+class EpochDomain {
+public:
+    class Guard {
+    public:
+        friend class EpochDomain;
+
+        friend void swap(Guard& lhs, Guard& rhs) {
+            std::swap(lhs.domain, rhs.domain);
+        }
+
+        // A guard that does not pin anything.
+        Guard() = default;
+        Guard(const Guard&);
+        Guard(Guard&&);
+        Guard& operator=(Guard);
+        ~Guard();
+    private:
+        explicit Guard(EpochDomain*);
+        EpochDomain* domain{nullptr};
+    };
+
+    static EpochDomain& global();
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+    ~EpochDomain();
+
+    // Pins may nest, the thread stays pinned until the outermost guard dies.
+    Guard pin();
+    // Frees pointer with deleter once no pinned thread can still reach it.
+    void retire(void* pointer, void (*deleter)(void*));
+private:
+    struct Retired {
+        void* pointer;
+        void (*deleter)(void*);
+        std::uint64_t epoch;
+    };
+
+    // The epoch a thread is pinned at, shifted left, with the lowest bit set
+    // while the thread is pinned.
+    struct alignas(cache_line_size) Slot {
+        std::atomic<std::uint64_t> state{0};
+        std::atomic<bool> in_use{true};
+        Slot* next{nullptr};
+    };
+
+    struct Participant {
+        Participant(EpochDomain&);
+        ~Participant();
+
+        EpochDomain& domain;
+        Slot* slot;
+        std::size_t nesting{0};
+        std::vector<Retired> retired;
+    };
+
+    // Number of retired pointers a thread buffers before trying to free them.
+    static constexpr std::size_t collect_threshold = 64;
+
+    EpochDomain() = default;
+
+    alignas(cache_line_size) std::atomic<std::uint64_t> epoch{0};
+    // Slots are never freed before the domain, only released for reuse by
+    // threads that come later.
+    alignas(cache_line_size) std::atomic<Slot*> slots{nullptr};
+    std::mutex orphans_mutex;
+    std::vector<Retired> orphans;
+
+    Participant& _participant();
+    Slot* _acquire_slot();
+    void _enter();
+    void _leave();
+    void _try_advance();
+    void _collect(std::vector<Retired>&);
+};
+
+inline EpochDomain::Guard::Guard(EpochDomain* domain)
+: domain(domain) {
+    if (domain)
+        domain->_enter();
+}
+
+inline EpochDomain::Guard::Guard(const Guard& other)
+: Guard(other.domain) {}
+
+inline EpochDomain::Guard::Guard(Guard&& other)
+: Guard() {
+    swap(*this, other);
+}
+
+inline auto EpochDomain::Guard::operator=(Guard other) -> Guard& {
+    swap(*this, other);
+    return *this;
+}
+
+inline EpochDomain::Guard::~Guard() {
+    if (domain)
+        domain->_leave();
+}
+
+inline auto EpochDomain::global() -> EpochDomain& {
+    static EpochDomain domain;
+    return domain;
+}
+
+inline EpochDomain::~EpochDomain() {
+    // Every other thread is gone by now, nothing can be pinned anymore.
+    for (auto& retired : orphans) {
+        retired.deleter(retired.pointer);
+    }
+    auto slot = slots.load(std::memory_order_relaxed);
+    while (slot) {
+        auto next = slot->next;
+        delete slot;
+        slot = next;
+    }
+}
+
+inline EpochDomain::Participant::Participant(EpochDomain& domain)
+: domain(domain)
+, slot(domain._acquire_slot()) {}
+
+inline EpochDomain::Participant::~Participant() {
+    domain._collect(retired);
+    if (not retired.empty()) {
+        std::lock_guard<std::mutex> lock(domain.orphans_mutex);
+        domain.orphans.insert(domain.orphans.end(), retired.begin(), retired.end());
+    }
+    slot->in_use.store(false, std::memory_order_release);
+}
+
+inline auto EpochDomain::_participant() -> Participant& {
+    static thread_local Participant participant(*this);
+    return participant;
+}
+
+inline auto EpochDomain::_acquire_slot() -> Slot* {
+    for (auto slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+        bool in_use = false;
+        if (slot->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+            return slot;
+    }
+
+    auto slot = new Slot;
+    slot->next = slots.load(std::memory_order_relaxed);
+    while (not slots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) {}
+    return slot;
+}
+
+inline auto EpochDomain::pin() -> Guard {
+    return Guard(this);
+}
+
+inline auto EpochDomain::_enter() -> void {
+    auto& participant = _participant();
+    if (participant.nesting++ == 0) {
+        auto current = epoch.load(std::memory_order_relaxed);
+        participant.slot->state.store(current << 1 | 1, std::memory_order_relaxed);
+        // Pairs with the fence in _try_advance: either the advancing thread
+        // sees this thread pinned, or this thread sees everything that was
+        // unlinked before the epoch moved.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline auto EpochDomain::_leave() -> void {
+    auto& participant = _participant();
+    if (--participant.nesting == 0)
+        participant.slot->state.store(0, std::memory_order_release);
+}
+
+inline auto EpochDomain::retire(void* pointer, void (*deleter)(void*)) -> void {
+    auto& participant = _participant();
+    participant.retired.push_back({pointer, deleter, epoch.load(std::memory_order_acquire)});
+    if (participant.retired.size() < collect_threshold)
+        return;
+
+    _try_advance();
+    _collect(participant.retired);
+
+    std::unique_lock<std::mutex> lock(orphans_mutex, std::try_to_lock);
+    if (lock.owns_lock())
+        _collect(orphans);
+}
+
+inline auto EpochDomain::_try_advance() -> void {
+    auto current = epoch.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (auto slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+        // Acquire, so that whatever a thread did before unpinning happens
+        // before anything retired now gets freed.
+        auto state = slot->state.load(std::memory_order_acquire);
+        if ((state & 1) and (state >> 1) != current)
+            return;
+    }
+    epoch.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel, std::memory_order_relaxed);
+}
+
+inline auto EpochDomain::_collect(std::vector<Retired>& retired) -> void {
+    auto current = epoch.load(std::memory_order_acquire);
+    auto kept = retired.begin();
+    for (auto& entry : retired) {
+        if (entry.epoch + 2 <= current)
+            entry.deleter(entry.pointer);
+        else
+            *kept++ = entry;
+    }
+    retired.erase(kept, retired.end());
+}
+
+} // namespace vds
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "TypeTraits.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include <utility>
+
+namespace vds {
+template <typename Key, typename Value, typename Compare>
+class OrderedArrayMap;
+
+// Read only snapshot of an OrderedArrayMap, obtained through freeze(). Entries
+// are stored in Eytzinger (breadth first) order of an implicit binary search
+// tree, so the nodes a search visits first are packed at the start of the
+// array, and a search is a branch free walk that prefetches the cache line of
+// its descendants ahead of time. The keys are additionally copied into their
+// own array in the same order so that a search only touches keys. Iteration
+// follows the in-order successor links of the tree.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class FrozenOrderedArrayMap {
+public:
+    using Entry = std::pair<Key, Value>;
+    using VectorSizeType = typename std::vector<Entry>::size_type;
+
+    class Iterator {
+    public:
+        friend class FrozenOrderedArrayMap;
+
+        const Entry& operator*() const;
+        const Entry* operator->() const;
+        bool operator==(const Iterator&) const;
+        bool operator!=(const Iterator&) const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        Iterator& operator--();
+        Iterator operator--(int);
+    private:
+        Iterator(const FrozenOrderedArrayMap*, VectorSizeType);
+        const FrozenOrderedArrayMap* map;
+        // Node of the implicit tree, 0 past the end.
+        VectorSizeType node;
+    };
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    VectorSizeType size() const;
+    bool empty() const;
+    Iterator find(const Key&) const;
+    Iterator lower_bound(const Key&) const;
+    Iterator upper_bound(const Key&) const;
+    std::pair<Iterator, Iterator> equal_range(const Key&) const;
+    VectorSizeType count(const Key&) const;
+
+    // Heterogeneous lookup, available when Compare declares is_transparent.
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator find(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator lower_bound(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator upper_bound(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    std::pair<Iterator, Iterator> equal_range(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    VectorSizeType count(const K&) const;
+private:
+    friend class OrderedArrayMap<Key, Value, Compare>;
+
+    FrozenOrderedArrayMap(std::vector<Entry>, Compare);
+
+    // entries[k - 1] and layout[k - 1] hold node k of the implicit tree, whose
+    // children are nodes 2k and 2k + 1.
+    std::vector<Entry> entries;
+    std::vector<Key> layout;
+    Compare compare;
+
+    void _build(VectorSizeType, VectorSizeType&, std::vector<VectorSizeType>&);
+    VectorSizeType _first() const;
+    VectorSizeType _last() const;
+    template <typename Descend>
+    VectorSizeType _search(Descend) const;
+    template <typename K>
+    VectorSizeType _lower_bound(const K&) const;
+    template <typename K>
+    VectorSizeType _upper_bound(const K&) const;
+    template <typename K>
+    VectorSizeType _find(const K&) const;
+    template <typename K>
+    std::pair<Iterator, Iterator> _equal_range(const K&) const;
+};
+
+template <typename Key, typename Value, typename Compare>
+FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::Iterator(const FrozenOrderedArrayMap* map, VectorSizeType node)
+: map(map)
+, node(node)
+{}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator*() const -> const Entry& {
+    return map->entries[node - 1];
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator->() const -> const Entry* {
+    return &map->entries[node - 1];
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator==(const Iterator& rhs) const -> bool {
+    return node == rhs.node;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator!=(const Iterator& rhs) const -> bool {
+    return !(node == rhs.node);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator++() -> Iterator& {
+    const auto n = map->entries.size();
+    if (2 * node + 1 <= n) {
+        // Leftmost node of the right subtree.
+        node = 2 * node + 1;
+        while (2 * node <= n) node = 2 * node;
+    } else {
+        // Climb while coming from a right child, then once more.
+        node >>= __builtin_ffsll(static_cast<long long>(~node));
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator++(int) -> Iterator {
+    Iterator copy(*this);
+    ++*this;
+    return copy;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator--() -> Iterator& {
+    const auto n = map->entries.size();
+    if (node == 0) {
+        node = map->_last();
+    } else if (2 * node <= n) {
+        // Rightmost node of the left subtree.
+        node = 2 * node;
+        while (2 * node + 1 <= n) node = 2 * node + 1;
+    } else {
+        // Climb while coming from a left child, then once more.
+        node >>= __builtin_ffsll(static_cast<long long>(node));
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::Iterator::operator--(int) -> Iterator {
+    Iterator copy(*this);
+    --*this;
+    return copy;
+}
+
+template <typename Key, typename Value, typename Compare>
+FrozenOrderedArrayMap<Key, Value, Compare>::FrozenOrderedArrayMap(std::vector<Entry> sorted_entries, Compare compare)
+: compare(std::move(compare))
+{
+    // rank[k - 1] is the position in sorted order of the entry at node k.
+    std::vector<VectorSizeType> rank(sorted_entries.size());
+    VectorSizeType next = 0;
+    _build(1, next, rank);
+
+    entries.reserve(sorted_entries.size());
+    layout.reserve(sorted_entries.size());
+    for (auto index : rank) {
+        layout.push_back(sorted_entries[index].first);
+        entries.push_back(std::move(sorted_entries[index]));
+    }
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_build(
+    VectorSizeType node,
+    VectorSizeType& next,
+    std::vector<VectorSizeType>& rank) -> void {
+    // An in-order walk of the implicit tree visits the nodes in key order.
+    if (node > rank.size())
+        return;
+    _build(2 * node, next, rank);
+    rank[node - 1] = next++;
+    _build(2 * node + 1, next, rank);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_first() const -> VectorSizeType {
+    if (entries.empty())
+        return 0;
+    VectorSizeType node = 1;
+    while (2 * node <= entries.size()) node = 2 * node;
+    return node;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_last() const -> VectorSizeType {
+    if (entries.empty())
+        return 0;
+    VectorSizeType node = 1;
+    while (2 * node + 1 <= entries.size()) node = 2 * node + 1;
+    return node;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Descend>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_search(Descend descend_right) const -> VectorSizeType {
+    // For a power of two prefetch_stride, nodes prefetch_stride * k onwards
+    // are the descendants of k log2(prefetch_stride) levels down, and that
+    // many keys fill about a cache line, which is requested now so it has
+    // arrived by the time the walk gets there.
+    constexpr VectorSizeType prefetch_stride = sizeof(Key) < 64 ? 64 / sizeof(Key) : 1;
+    const VectorSizeType n = layout.size();
+
+    VectorSizeType node = 1;
+    while (node <= n) {
+        if (prefetch_stride * node <= n)
+            __builtin_prefetch(layout.data() + prefetch_stride * node - 1);
+        node = 2 * node + static_cast<VectorSizeType>(descend_right(layout[node - 1]));
+    }
+
+    // The answer is the last node where the walk went left: strip the trailing
+    // right turns (ones) and that left turn (a zero) off the path. No left turn
+    // at all leaves 0, the end.
+    node >>= __builtin_ffsll(static_cast<long long>(~node));
+    return node;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_lower_bound(const K& key) const -> VectorSizeType {
+    return _search([&](const Key& stored) { return compare(stored, key); });
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_upper_bound(const K& key) const -> VectorSizeType {
+    return _search([&](const Key& stored) { return !compare(key, stored); });
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_find(const K& key) const -> VectorSizeType {
+    auto node = _lower_bound(key);
+    if (node != 0 && !compare(key, layout[node - 1]))
+        return node;
+    return 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::_equal_range(const K& key) const -> std::pair<Iterator, Iterator> {
+    Iterator it(this, _lower_bound(key));
+    if (it.node != 0 && !compare(key, layout[it.node - 1]))
+        return {it, std::next(it)};
+    return {it, it};
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::begin() const -> Iterator {
+    return Iterator(this, _first());
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::end() const -> Iterator {
+    return Iterator(this, 0);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::size() const -> VectorSizeType {
+    return entries.size();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::empty() const -> bool {
+    return entries.empty();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::find(const Key& key) const -> Iterator {
+    return Iterator(this, _find(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::find(const K& key) const -> Iterator {
+    return Iterator(this, _find(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::lower_bound(const Key& key) const -> Iterator {
+    return Iterator(this, _lower_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::lower_bound(const K& key) const -> Iterator {
+    return Iterator(this, _lower_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::upper_bound(const Key& key) const -> Iterator {
+    return Iterator(this, _upper_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::upper_bound(const K& key) const -> Iterator {
+    return Iterator(this, _upper_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::equal_range(const Key& key) const -> std::pair<Iterator, Iterator> {
+    return _equal_range(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::equal_range(const K& key) const -> std::pair<Iterator, Iterator> {
+    return _equal_range(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::count(const Key& key) const -> VectorSizeType {
+    return _find(key) != 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto FrozenOrderedArrayMap<Key, Value, Compare>::count(const K& key) const -> VectorSizeType {
+    return _find(key) != 0;
+}
+}
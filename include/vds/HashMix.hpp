@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vds {
+
+// Scrambles the output of a user supplied hasher so that tables indexed with
+// power of two masks do not degrade on identity hashes (e.g. std::hash<int>).
+inline std::uint64_t mix_hash(std::size_t hash) {
+    std::uint64_t h = static_cast<std::uint64_t>(hash);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+} // namespace vds
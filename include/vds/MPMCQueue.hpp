@@ -0,0 +1,203 @@
+#pragma once
+
+#include "CacheLine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace vds {
+
+// Bounded FIFO queue for any number of producer and consumer threads (Dmitry
+// Vyukov's design). Each cell carries a sequence number telling which lap of
+// the ring it is ready for: a cell at position p can be written once its
+// sequence is p, and read once it is p + 1. Producers and consumers claim
+// positions with a CAS on their own index, each on its own cache line, and
+// then only touch the cells they claimed, so a push and a pop never contend
+// with each other unless the queue is nearly full or empty.
+//
+// It is lock-free rather than wait-free: a thread that claimed a cell and
+// stalls before publishing it holds up whoever reaches that cell next. For the
+// same reason, constructing an element in a claimed cell must not throw.
+template <typename T>
+class MPMCQueue {
+public:
+    // The capacity is rounded up to a power of two, and is at least 2.
+    explicit MPMCQueue(std::size_t capacity);
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+    ~MPMCQueue();
+
+    bool try_push(const T&);
+    bool try_push(T&&);
+    template <typename... Args>
+    bool try_emplace(Args&&...);
+    // Claims as many consecutive free cells as are ready, up to n, with one
+    // CAS, fills them from first and returns how many that was.
+    template <typename InputIt>
+    std::size_t try_push_n(InputIt first, std::size_t n);
+
+    bool try_pop(T&);
+    // Claims up to n consecutive elements with one CAS, moves them to out and
+    // returns how many there were.
+    template <typename OutputIt>
+    std::size_t try_pop_n(OutputIt out, std::size_t n);
+
+    std::size_t capacity() const;
+    // Only a snapshot while other threads are running.
+    std::size_t size() const;
+    bool empty() const;
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    std::size_t mask;
+    std::unique_ptr<Cell[]> cells;
+
+    alignas(cache_line_size) std::atomic<std::size_t> enqueue_position{0};
+    alignas(cache_line_size) std::atomic<std::size_t> dequeue_position{0};
+
+    Cell& _cell(std::size_t position) const;
+    T* _element(Cell&) const;
+    // Claims up to n consecutive positions whose cells have reached
+    // position + lag, and returns the first one and how many were claimed.
+    std::pair<std::size_t, std::size_t> _claim(std::atomic<std::size_t>& index, std::size_t lag, std::size_t n);
+};
+
+template <typename T>
+MPMCQueue<T>::MPMCQueue(std::size_t capacity) {
+    std::size_t rounded = 2;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    mask = rounded - 1;
+    cells = std::make_unique<Cell[]>(rounded);
+    for (std::size_t position = 0; position < rounded; ++position) {
+        cells[position].sequence.store(position, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+MPMCQueue<T>::~MPMCQueue() {
+    auto end = enqueue_position.load(std::memory_order_relaxed);
+    for (auto position = dequeue_position.load(std::memory_order_relaxed); position != end; ++position) {
+        _element(_cell(position))->~T();
+    }
+}
+
+template <typename T>
+auto MPMCQueue<T>::try_push(const T& element) -> bool {
+    return try_emplace(element);
+}
+
+template <typename T>
+auto MPMCQueue<T>::try_push(T&& element) -> bool {
+    return try_emplace(std::move(element));
+}
+
+template <typename T>
+template <typename... Args>
+auto MPMCQueue<T>::try_emplace(Args&&... args) -> bool {
+    auto [position, count] = _claim(enqueue_position, 0, 1);
+    if (count == 0)
+        return false;
+    auto& cell = _cell(position);
+    new (cell.bytes) T(std::forward<Args>(args)...);
+    cell.sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+template <typename InputIt>
+auto MPMCQueue<T>::try_push_n(InputIt first, std::size_t n) -> std::size_t {
+    auto [position, count] = _claim(enqueue_position, 0, n);
+    for (std::size_t i = 0; i < count; ++i, ++first) {
+        auto& cell = _cell(position + i);
+        new (cell.bytes) T(*first);
+        cell.sequence.store(position + i + 1, std::memory_order_release);
+    }
+    return count;
+}
+
+template <typename T>
+auto MPMCQueue<T>::try_pop(T& element) -> bool {
+    return try_pop_n(&element, 1) == 1;
+}
+
+template <typename T>
+template <typename OutputIt>
+auto MPMCQueue<T>::try_pop_n(OutputIt out, std::size_t n) -> std::size_t {
+    auto [position, count] = _claim(dequeue_position, 1, n);
+    for (std::size_t i = 0; i < count; ++i, ++out) {
+        auto& cell = _cell(position + i);
+        auto element = _element(cell);
+        *out = std::move(*element);
+        element->~T();
+        // Ready to be written again on the next lap.
+        cell.sequence.store(position + i + mask + 1, std::memory_order_release);
+    }
+    return count;
+}
+
+template <typename T>
+auto MPMCQueue<T>::capacity() const -> std::size_t {
+    return mask + 1;
+}
+
+template <typename T>
+auto MPMCQueue<T>::size() const -> std::size_t {
+    // Dequeues never overtake enqueues, so reading the dequeue index first
+    // keeps the difference from going negative.
+    auto first = dequeue_position.load(std::memory_order_acquire);
+    auto end = enqueue_position.load(std::memory_order_acquire);
+    return std::min(end - first, capacity());
+}
+
+template <typename T>
+auto MPMCQueue<T>::empty() const -> bool {
+    return size() == 0;
+}
+
+template <typename T>
+auto MPMCQueue<T>::_cell(std::size_t position) const -> Cell& {
+    return cells[position & mask];
+}
+
+template <typename T>
+auto MPMCQueue<T>::_element(Cell& cell) const -> T* {
+    return std::launder(reinterpret_cast<T*>(cell.bytes));
+}
+
+template <typename T>
+auto MPMCQueue<T>::_claim(std::atomic<std::size_t>& index, std::size_t lag, std::size_t n) -> std::pair<std::size_t, std::size_t> {
+    auto position = index.load(std::memory_order_relaxed);
+    while (n > 0) {
+        auto difference = static_cast<std::intptr_t>(
+            _cell(position).sequence.load(std::memory_order_acquire) - (position + lag));
+        if (difference < 0) {
+            // The cell is a lap behind: full for producers, empty for consumers.
+            return {position, 0};
+        }
+        if (difference > 0) {
+            // Someone else claimed the position already.
+            position = index.load(std::memory_order_relaxed);
+            continue;
+        }
+        std::size_t count = 1;
+        while (count < n && count <= mask
+               && _cell(position + count).sequence.load(std::memory_order_acquire) == position + count + lag) {
+            ++count;
+        }
+        if (index.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+            return {position, count};
+    }
+    return {position, 0};
+}
+
+} // namespace vds
@@ -1,49 +1,136 @@
 #pragma once
 
+#include "FrozenOrderedArrayMap.hpp"
+#include "TypeTraits.hpp"
+
 #include <algorithm>
+#include <type_traits>
 #include <vector>
 #include <utility>
 
 namespace vds {
+// Tag for constructors that take entries which are already sorted by the
+// map's Compare and free of duplicate keys, so they can be adopted as is.
+struct from_sorted_unique_t {
+    explicit from_sorted_unique_t() = default;
+};
+inline constexpr from_sorted_unique_t from_sorted_unique{};
+
+// Flat map: entries are kept in a vector sorted by Compare, so lookups are
+// binary searches over contiguous memory and iteration is in key order.
 template <typename Key, typename Value, typename Compare = std::less<Key>>
 class OrderedArrayMap {
 public:
     using Entry = std::pair<Key, Value>;
     using VectorIterator = typename std::vector<Entry>::iterator;
+    using ConstVectorIterator = typename std::vector<Entry>::const_iterator;
     using VectorSizeType = typename std::vector<Entry>::size_type;
-    class Iterator {
+
+    // Iterator when Const is false, ConstIterator when it is true, which only
+    // gives const access to the entries.
+    template <bool Const>
+    class BasicIterator {
     public:
         friend class OrderedArrayMap;
+        friend class BasicIterator<!Const>;
 
-        Entry& operator*();
-        Entry* operator->();
-        bool operator==(const Iterator&) const;
-        bool operator!=(const Iterator&) const;
-        Iterator& operator++();
-        Iterator operator++(int);
-        Iterator& operator--();
-        Iterator operator--(int);
+        using Reference = std::conditional_t<Const, const Entry&, Entry&>;
+        using Pointer = std::conditional_t<Const, const Entry*, Entry*>;
+
+        template <bool WasConst, typename = std::enable_if_t<Const && !WasConst>>
+        BasicIterator(const BasicIterator<WasConst>&);
+
+        Reference operator*() const;
+        Pointer operator->() const;
+        bool operator==(const BasicIterator&) const;
+        bool operator!=(const BasicIterator&) const;
+        BasicIterator& operator++();
+        BasicIterator operator++(int);
+        BasicIterator& operator--();
+        BasicIterator operator--(int);
     private:
-        Iterator() = default;
-        Iterator(VectorIterator);
-        VectorIterator it;
+        using It = std::conditional_t<Const, ConstVectorIterator, VectorIterator>;
+
+        BasicIterator() = default;
+        BasicIterator(It);
+        It it;
     };
 
+    using Iterator = BasicIterator<false>;
+    using ConstIterator = BasicIterator<true>;
+
     OrderedArrayMap(Compare compare = Compare());
+    template <typename InputIt, typename = iterator_category_t<InputIt>>
+    OrderedArrayMap(InputIt first, InputIt last, Compare compare = Compare());
+    OrderedArrayMap(from_sorted_unique_t, std::vector<Entry> entries, Compare compare = Compare());
+    template <typename InputIt, typename = iterator_category_t<InputIt>>
+    OrderedArrayMap(from_sorted_unique_t, InputIt first, InputIt last, Compare compare = Compare());
 
     Iterator begin();
     Iterator end();
+    ConstIterator begin() const;
+    ConstIterator end() const;
 
     VectorSizeType size() const;
     bool empty() const;
-    Iterator find(const Key&) const;
+    Iterator find(const Key&);
+    ConstIterator find(const Key&) const;
+    Iterator lower_bound(const Key&);
+    ConstIterator lower_bound(const Key&) const;
+    Iterator upper_bound(const Key&);
+    ConstIterator upper_bound(const Key&) const;
+    std::pair<Iterator, Iterator> equal_range(const Key&);
+    std::pair<ConstIterator, ConstIterator> equal_range(const Key&) const;
     Iterator insert(Key, Value);
+    template <typename InputIt, typename = iterator_category_t<InputIt>>
+    void insert(InputIt first, InputIt last);
     void erase(const Key&);
     void erase(Iterator);
+    VectorSizeType count(const Key&) const;
     Value& operator[](Key&& key);
+
+    // Read only snapshot with a search optimized layout, see
+    // FrozenOrderedArrayMap.
+    FrozenOrderedArrayMap<Key, Value, Compare> freeze() const&;
+    FrozenOrderedArrayMap<Key, Value, Compare> freeze() &&;
+
+    // Heterogeneous lookup, available when Compare declares is_transparent.
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator find(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    ConstIterator find(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator lower_bound(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    ConstIterator lower_bound(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator upper_bound(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    ConstIterator upper_bound(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    std::pair<Iterator, Iterator> equal_range(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    std::pair<ConstIterator, ConstIterator> equal_range(const K&) const;
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    void erase(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    VectorSizeType count(const K&) const;
 private:
     std::vector<Entry> entries;
     Compare compare;
+
+    // Shared by the const and non const lookups, Self being either; they
+    // return a vector iterator of matching constness.
+    template <typename Self, typename K>
+    static auto _lower_bound(Self&, const K&);
+    template <typename Self, typename K>
+    static auto _upper_bound(Self&, const K&);
+    template <typename Self, typename K>
+    static auto _find(Self&, const K&);
+    template <typename Self, typename K>
+    static auto _equal_range(Self&, const K&);
+    template <typename K>
+    void _erase(const K&);
 };
 
 template <typename Key, typename Value, typename Compare>
@@ -52,52 +139,89 @@ OrderedArrayMap<Key, Value, Compare>::OrderedArrayMap(Compare compare)
 {}
 
 template <typename Key, typename Value, typename Compare>
-OrderedArrayMap<Key, Value, Compare>::Iterator::Iterator(VectorIterator vit) 
+template <typename InputIt, typename>
+OrderedArrayMap<Key, Value, Compare>::OrderedArrayMap(InputIt first, InputIt last, Compare compare)
+: compare(std::move(compare))
+{
+    insert(first, last);
+}
+
+template <typename Key, typename Value, typename Compare>
+OrderedArrayMap<Key, Value, Compare>::OrderedArrayMap(from_sorted_unique_t, std::vector<Entry> entries, Compare compare)
+: entries(std::move(entries))
+, compare(std::move(compare))
+{}
+
+template <typename Key, typename Value, typename Compare>
+template <typename InputIt, typename>
+OrderedArrayMap<Key, Value, Compare>::OrderedArrayMap(from_sorted_unique_t, InputIt first, InputIt last, Compare compare)
+: entries(first, last)
+, compare(std::move(compare))
+{}
+
+template <typename Key, typename Value, typename Compare>
+template <bool Const>
+OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::BasicIterator(It vit)
 :it(std::move(vit))
 {}
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator*() -> Entry& {
+template <bool Const>
+template <bool WasConst, typename>
+OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::BasicIterator(const BasicIterator<WasConst>& other)
+:it(other.it)
+{}
+
+template <typename Key, typename Value, typename Compare>
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator*() const -> Reference {
     return *it;
 } 
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator->() -> Entry* {
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator->() const -> Pointer {
     return &(*it);
 } 
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator==(const Iterator& rhs) const -> bool {
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator==(const BasicIterator& rhs) const -> bool {
     return it == rhs.it;
 }
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator!=(const Iterator& rhs) const -> bool {
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator!=(const BasicIterator& rhs) const -> bool {
     return !(it == rhs.it);
 }
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator++() -> Iterator& {
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator++() -> BasicIterator& {
     ++it;
     return *this;
 }
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator++(int) -> Iterator {
-    Iterator copy(*this);
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator++(int) -> BasicIterator {
+    BasicIterator copy(*this);
     ++*this;
     return copy;
 }
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator--() -> Iterator& {
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator--() -> BasicIterator& {
     --it;
     return *this;
 }
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::Iterator::operator--(int) -> Iterator {
-    Iterator copy(*this);
+template <bool Const>
+auto OrderedArrayMap<Key, Value, Compare>::BasicIterator<Const>::operator--(int) -> BasicIterator {
+    BasicIterator copy(*this);
     --*this;
     return copy;
 }
@@ -123,32 +247,196 @@ auto OrderedArrayMap<Key, Value, Compare>::end() -> Iterator {
 }
 
 template <typename Key, typename Value, typename Compare>
-auto OrderedArrayMap<Key, Value, Compare>::find(const Key& key) const -> Iterator {
-    auto it = begin();
-    while (it != end() && it->first != key)
-        it++;
-    return it;
+auto OrderedArrayMap<Key, Value, Compare>::begin() const -> ConstIterator {
+    return ConstIterator(entries.begin());
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::end() const -> ConstIterator {
+    return ConstIterator(entries.end());
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Self, typename K>
+auto OrderedArrayMap<Key, Value, Compare>::_lower_bound(Self& self, const K& key) {
+    return std::lower_bound(self.entries.begin(), self.entries.end(), key, [&self](const Entry& entry, const K& searched) {
+        return self.compare(entry.first, searched);
+    });
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Self, typename K>
+auto OrderedArrayMap<Key, Value, Compare>::_upper_bound(Self& self, const K& key) {
+    return std::upper_bound(self.entries.begin(), self.entries.end(), key, [&self](const K& searched, const Entry& entry) {
+        return self.compare(searched, entry.first);
+    });
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Self, typename K>
+auto OrderedArrayMap<Key, Value, Compare>::_find(Self& self, const K& key) {
+    auto it = _lower_bound(self, key);
+    if (it != self.entries.end() && !self.compare(key, it->first))
+        return it;
+    return self.entries.end();
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Self, typename K>
+auto OrderedArrayMap<Key, Value, Compare>::_equal_range(Self& self, const K& key) {
+    using It = BasicIterator<std::is_const_v<Self>>;
+    // Keys are unique, so the range holds at most the entry lower_bound found.
+    auto it = _lower_bound(self, key);
+    if (it != self.entries.end() && !self.compare(key, it->first))
+        return std::make_pair(It(it), It(it + 1));
+    return std::make_pair(It(it), It(it));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto OrderedArrayMap<Key, Value, Compare>::_erase(const K& key) -> void {
+    auto it = _find(*this, key);
+    if (it != entries.end())
+        entries.erase(it);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::find(const Key& key) -> Iterator {
+    return Iterator(_find(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::find(const Key& key) const -> ConstIterator {
+    return ConstIterator(_find(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::find(const K& key) -> Iterator {
+    return Iterator(_find(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::find(const K& key) const -> ConstIterator {
+    return ConstIterator(_find(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::lower_bound(const Key& key) -> Iterator {
+    return Iterator(_lower_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::lower_bound(const Key& key) const -> ConstIterator {
+    return ConstIterator(_lower_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::lower_bound(const K& key) -> Iterator {
+    return Iterator(_lower_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::lower_bound(const K& key) const -> ConstIterator {
+    return ConstIterator(_lower_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::upper_bound(const Key& key) -> Iterator {
+    return Iterator(_upper_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::upper_bound(const Key& key) const -> ConstIterator {
+    return ConstIterator(_upper_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::upper_bound(const K& key) -> Iterator {
+    return Iterator(_upper_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::upper_bound(const K& key) const -> ConstIterator {
+    return ConstIterator(_upper_bound(*this, key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::equal_range(const Key& key) -> std::pair<Iterator, Iterator> {
+    return _equal_range(*this, key);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::equal_range(const Key& key) const -> std::pair<ConstIterator, ConstIterator> {
+    return _equal_range(*this, key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::equal_range(const K& key) -> std::pair<Iterator, Iterator> {
+    return _equal_range(*this, key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::equal_range(const K& key) const -> std::pair<ConstIterator, ConstIterator> {
+    return _equal_range(*this, key);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::count(const Key& key) const -> VectorSizeType {
+    return _find(*this, key) != entries.end();
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::count(const K& key) const -> VectorSizeType {
+    return _find(*this, key) != entries.end();
 }
 
 template <typename Key, typename Value, typename Compare>
 auto OrderedArrayMap<Key, Value, Compare>::insert(Key key, Value value) -> Iterator {
-    for (auto& entry : *this) {
-        if (compare(entry->fist, key)) {
-            entry = {std::move(key), std::move(value)};
-            return;
-        }
-    }
-    entries.push_back({std::move(key), std::move(value)});
+    auto it = _lower_bound(*this, key);
+    if (it != entries.end() && !compare(key, it->first))
+        return Iterator(it);
+    return Iterator(entries.insert(it, {std::move(key), std::move(value)}));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename InputIt, typename>
+auto OrderedArrayMap<Key, Value, Compare>::insert(InputIt first, InputIt last) -> void {
+    // Sort the batch on its own and merge it into the existing entries,
+    // instead of shifting the vector tail once per inserted entry. Both sorts
+    // are stable, so when a key repeats, the entry that was there first wins,
+    // as it does for single inserts.
+    auto by_key = [this](const Entry& lhs, const Entry& rhs) {
+        return compare(lhs.first, rhs.first);
+    };
+    auto batch_begin = static_cast<typename std::vector<Entry>::difference_type>(entries.size());
+    entries.insert(entries.end(), first, last);
+    std::stable_sort(entries.begin() + batch_begin, entries.end(), by_key);
+    std::inplace_merge(entries.begin(), entries.begin() + batch_begin, entries.end(), by_key);
+
+    auto same_key = [this](const Entry& kept, const Entry& next) {
+        return !compare(kept.first, next.first);
+    };
+    entries.erase(std::unique(entries.begin(), entries.end(), same_key), entries.end());
 }
 
 template <typename Key, typename Value, typename Compare>
 auto OrderedArrayMap<Key, Value, Compare>::erase(const Key& key) -> void {
-    auto entryIterator = begin();
-    while (entryIterator != end() && entryIterator->first != key)
-        entryIterator++;
-    
-    if (entryIterator == end()) return;
-    entries.erase(entryIterator.it);
+    _erase(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedArrayMap<Key, Value, Compare>::erase(const K& key) -> void {
+    _erase(key);
 }
 
 template <typename Key, typename Value, typename Compare>
@@ -156,16 +444,22 @@ auto OrderedArrayMap<Key, Value, Compare>::erase(Iterator it) -> void {
     entries.erase(it.it);
 }
 
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::freeze() const& -> FrozenOrderedArrayMap<Key, Value, Compare> {
+    return FrozenOrderedArrayMap<Key, Value, Compare>(entries, compare);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedArrayMap<Key, Value, Compare>::freeze() && -> FrozenOrderedArrayMap<Key, Value, Compare> {
+    return FrozenOrderedArrayMap<Key, Value, Compare>(std::move(entries), std::move(compare));
+}
+
 template <typename Key, typename Value, typename Compare>
 auto OrderedArrayMap<Key, Value, Compare>::operator[](Key&& key) -> Value& {
-    auto entryIterator = begin();
-    while(entryIterator != end() && entryIterator->first != key)
-        entryIterator++;
-    if (entryIterator != end()) {
-        return entryIterator->second;
-    }
-    entries.push_back({std::forward<Key>(key), Value()});
-    return entries.back().second;
+    auto it = _lower_bound(*this, key);
+    if (it == entries.end() || compare(key, it->first))
+        it = entries.emplace(it, std::forward<Key>(key), Value());
+    return it->second;
 }
 }
 
@@ -1,88 +1,127 @@
 #pragma once
 
-#include <vector>
-#include <variant>
-#include <list>
-#include <cstdlib>
-#include <iostream>
-
+#include "SkipListLevelGenerator.hpp"
+#include "Trace.hpp"
+#include "TypeTraits.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+
+// A skip list node is a single allocation: the entry, the link back to the
+// previous node on the bottom level, and right behind it an array of `height`
+// forward links, one per level the node takes part in.
 template <typename Key, typename Value>
-struct SkipListEntry {
+struct SkipListNode {
     using Entry = std::pair<Key, Value>;
 
-    SkipListEntry(
-        Entry* entry = nullptr,
-        SkipListEntry* next = nullptr,
-        SkipListEntry* prev = nullptr,
-        SkipListEntry* below = nullptr,
-        SkipListEntry* above = nullptr)
-    : entry(entry)
-    , next(next)
-    , prev(prev)
-    , below(below)
-    , above(above) {}
-
-    Entry* entry{nullptr};
-
-    SkipListEntry* next{nullptr};
-    SkipListEntry* prev{nullptr};
-    SkipListEntry* below{nullptr};
-    SkipListEntry* above{nullptr};
-
-    bool is_minus_inf();
-    bool is_inf();
-    bool is_top();
-    bool is_bottom();
+    // A forward link also counts how many bottom level steps it skips, which
+    // makes positions computable on the way down. Links to nullptr do not keep
+    // a meaningful width, nothing is ever counted past the last node.
+    struct Link {
+        SkipListNode* next;
+        size_t width;
+    };
+
+    SkipListNode(size_t height, Key key, Value value)
+    : entry(std::move(key), std::move(value))
+    , height(height) {}
+
+    Entry entry;
+    SkipListNode* prev{nullptr};
+    size_t height;
+
+    Link* links();
 
     Key& key();
     Value& value();
+
+    // Nodes are allocated as a whole number of units, through an allocator
+    // rebound to SkipListUnit.
+    static size_t units(size_t height);
+    template <typename UnitAllocator>
+    static SkipListNode* create(UnitAllocator&, size_t height, Key key, Value value);
+    template <typename UnitAllocator>
+    static void destroy(UnitAllocator&, SkipListNode*);
+};
+
+struct alignas(std::max_align_t) SkipListUnit {
+    unsigned char bytes[alignof(std::max_align_t)];
 };
 
 template <typename Key, typename Value>
-auto SkipListEntry<Key, Value>::is_minus_inf() -> bool {
-    return prev == nullptr;
+auto SkipListNode<Key, Value>::links() -> Link* {
+    // The node holds a pointer and a size_t, so its size is a multiple of the
+    // alignment the trailing link array needs.
+    return std::launder(reinterpret_cast<Link*>(this + 1));
 }
 
 template <typename Key, typename Value>
-auto SkipListEntry<Key, Value>::is_inf() -> bool {
-    return next == nullptr;
+auto SkipListNode<Key, Value>::key() -> Key& {
+    return entry.first;
 }
 
 template <typename Key, typename Value>
-auto SkipListEntry<Key, Value>::is_bottom() -> bool {
-    return below == nullptr;
+auto SkipListNode<Key, Value>::value() -> Value& {
+    return entry.second;
 }
 
 template <typename Key, typename Value>
-auto SkipListEntry<Key, Value>::is_top() -> bool {
-    return above == nullptr;
+auto SkipListNode<Key, Value>::units(size_t height) -> size_t {
+    static_assert(alignof(SkipListNode) <= alignof(SkipListUnit), "over-aligned entries are not supported");
+    return (sizeof(SkipListNode) + height * sizeof(Link) + sizeof(SkipListUnit) - 1) / sizeof(SkipListUnit);
 }
 
 template <typename Key, typename Value>
-auto SkipListEntry<Key, Value>::key() -> Key& {
-    return entry->first;
+template <typename UnitAllocator>
+auto SkipListNode<Key, Value>::create(UnitAllocator& allocator, size_t height, Key key, Value value) -> SkipListNode* {
+    using Traits = std::allocator_traits<UnitAllocator>;
+    auto memory = Traits::allocate(allocator, units(height));
+    SkipListNode* node;
+    try {
+        node = new (static_cast<void*>(memory)) SkipListNode(height, std::move(key), std::move(value));
+    } catch (...) {
+        Traits::deallocate(allocator, memory, units(height));
+        throw;
+    }
+    std::uninitialized_fill_n(reinterpret_cast<Link*>(node + 1), height, Link{nullptr, 0});
+    return node;
 }
 
 template <typename Key, typename Value>
-auto SkipListEntry<Key, Value>::value() -> Value& {
-    return entry->second;
+template <typename UnitAllocator>
+auto SkipListNode<Key, Value>::destroy(UnitAllocator& allocator, SkipListNode* node) -> void {
+    auto node_units = units(node->height);
+    node->~SkipListNode();
+    std::allocator_traits<UnitAllocator>::deallocate(allocator, reinterpret_cast<SkipListUnit*>(node), node_units);
 }
 
 
-template <typename Key, typename Value, typename Compare>
-class OrderedSkipListMap;
-
-template <typename Key, typename Value, typename Compare = std::less<Key>>
+template <typename Key, typename Value, typename Compare = std::less<Key>, typename Allocator = std::allocator<std::pair<Key, Value>>>
 class OrderedSkipListMap {
 public:
-    using Entry = SkipListEntry<Key, Value>;
+    using Node = SkipListNode<Key, Value>;
+    using Entry = typename Node::Entry;
+    using AllocatorType = Allocator;
+
+    static constexpr size_t max_level = 32;
 
     class Iterator {
     public:
         friend class OrderedSkipListMap;
 
-        typename Entry::Entry& operator*();
-        typename Entry::Entry* operator->();
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Entry*;
+        using reference = Entry&;
+
+        Entry& operator*();
+        Entry* operator->();
         bool operator==(const Iterator&) const;
         bool operator!=(const Iterator&) const;
         Iterator& operator++();
@@ -90,278 +129,629 @@ public:
         Iterator& operator--();
         Iterator operator--(int);
     private:
-        Iterator(Entry*);
-        Entry* current;
+        Iterator(Node*, const OrderedSkipListMap*);
+        Node* current;
+        // Needed to step back from end(), where current is null.
+        const OrderedSkipListMap* map;
+    };
+
+    using ReverseIterator = std::reverse_iterator<Iterator>;
+
+    // The entries between two iterators, as returned by range(). It is only a
+    // pair of iterators, the entries are streamed from the bottom level.
+    class Range {
+    public:
+        friend class OrderedSkipListMap;
+
+        Iterator begin() const;
+        Iterator end() const;
+        bool empty() const;
+    private:
+        Range(Iterator, Iterator);
+        Iterator first;
+        Iterator last;
     };
 
     friend void swap(OrderedSkipListMap& lhs, OrderedSkipListMap& rhs) {
         using std::swap;
-        swap(lhs.less, rhs.less);
-        swap(lhs.top_left, rhs.top_left);
-        swap(lhs.top_right, rhs.top_right);
-        swap(lhs.bottom_left, rhs.bottom_left);
-        swap(lhs.bottom_right, rhs.bottom_right);
-        swap(lhs.entries, rhs.entries);
+        // Without propagation, the allocators have to compare equal, as for
+        // the standard containers.
+        if constexpr (UnitTraits::propagate_on_container_swap::value)
+            swap(lhs.allocator, rhs.allocator);
+        lhs._swap_contents(rhs);
     }
 
-    OrderedSkipListMap(Compare = Compare());
+    OrderedSkipListMap(
+        Compare = Compare(),
+        vds::SkipListLevelGenerator = vds::SkipListLevelGenerator(),
+        const Allocator& = Allocator());
     OrderedSkipListMap(const OrderedSkipListMap&);
     OrderedSkipListMap(OrderedSkipListMap&&);
-    OrderedSkipListMap& operator=(OrderedSkipListMap);
+    OrderedSkipListMap& operator=(const OrderedSkipListMap&);
+    OrderedSkipListMap& operator=(OrderedSkipListMap&&);
     ~OrderedSkipListMap();
 
+    Allocator get_allocator() const;
+
     Iterator begin() const;
     Iterator end() const;
+    ReverseIterator rbegin() const;
+    ReverseIterator rend() const;
 
     size_t size() const;
     bool empty() const;
     Iterator find(const Key&) const;
+    Iterator lower_bound(const Key&) const;
+    Iterator upper_bound(const Key&) const;
+    std::pair<Iterator, Iterator> equal_range(const Key&) const;
+    // Entries with keys in [lo, hi), in O(log n) plus the number of entries.
+    Range range(const Key& lo, const Key& hi) const;
+    // The entry at zero based position k in key order, or end(), in O(log n).
+    Iterator nth(size_t k) const;
+    // Number of entries with keys less than key, in O(log n).
+    size_t rank(const Key&) const;
+    // Number of entries with keys in [lo, hi), in O(log n).
+    size_t count_in_range(const Key& lo, const Key& hi) const;
     Iterator insert(Key, Value);
     void erase(const Key&);
     void erase(Iterator);
+    size_t count(const Key&) const;
     Value& operator[](Key&& key);
+
+    // Heterogeneous lookup, available when Compare declares is_transparent.
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    Iterator find(const K&) const;
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    Iterator lower_bound(const K&) const;
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    Iterator upper_bound(const K&) const;
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    std::pair<Iterator, Iterator> equal_range(const K&) const;
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    Range range(const K& lo, const K& hi) const;
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    size_t rank(const K&) const;
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    size_t count_in_range(const K& lo, const K& hi) const;
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    void erase(const K&);
+    template <typename K, typename = vds::transparent_key_t<Compare, K>>
+    size_t count(const K&) const;
 private:
-    // Object for managing ownership of entries in order to avoid unnecessary
-    // duplication in upper layers of the skip list.
-    std::list<typename Entry::Entry> entries;
+    using Link = typename Node::Link;
+    using UnitAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<SkipListUnit>;
+    using UnitTraits = std::allocator_traits<UnitAllocator>;
+    using Predecessors = std::array<Node*, max_level>;
+    using Ranks = std::array<size_t, max_level>;
 
     Compare less;
-    Entry* top_left;
-    Entry* top_right;
-    Entry* bottom_left;
-    Entry* bottom_right;
-
-    Entry* _find_after(const Key& key) const; 
-    void _create_layer_above();
+    vds::SkipListLevelGenerator levels;
+    UnitAllocator allocator;
+    // Forward links of the head of the list, which has no entry of its own and
+    // sits at position 0. Wherever a predecessor is expected, nullptr stands
+    // for the head.
+    std::array<Link, max_level> head{};
+    Node* tail{nullptr};
+    // Number of levels currently in use.
+    size_t level{1};
+    size_t element_count{0};
+
+    Link* _links(Node*);
+    const Link* _links(Node*) const;
+    template <typename GoesRight>
+    std::pair<Node*, size_t> _descend(GoesRight goes_right, Node** predecessors = nullptr, size_t* ranks = nullptr) const;
+    template <typename K>
+    Node* _find_after(const K& key, Node** predecessors = nullptr, size_t* ranks = nullptr) const;
+    template <typename K>
+    Node* _upper_bound(const K& key) const;
+    template <typename K>
+    Node* _find(const K& key) const;
+    template <typename K>
+    std::pair<Iterator, Iterator> _equal_range(const K& key) const;
+    template <typename K>
+    size_t _count(const K& key) const;
+    template <typename K>
+    size_t _rank(const K& key) const;
+    template <typename K>
+    size_t _count_in_range(const K& lo, const K& hi) const;
+    template <typename K>
+    void _erase(const K& key);
+    size_t _random_height();
+    void _swap_contents(OrderedSkipListMap&);
+    void _append(const OrderedSkipListMap&);
     void clear();
 };
 
-template <typename Key, typename Value, typename Compare>
-OrderedSkipListMap<Key, Value, Compare>::Iterator::Iterator(Entry* current)
-: current{current} {}
+template <typename Key, typename Value, typename Compare, typename Allocator>
+OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::Iterator(Node* current, const OrderedSkipListMap* map)
+: current{current}
+, map{map} {}
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator*() -> typename Entry::Entry& {
-    return *current->entry;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator*() -> Entry& {
+    return current->entry;
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator->() -> typename Entry::Entry* {
-    return current->entry;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator->() -> Entry* {
+    return &current->entry;
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator==(const Iterator& other) const -> bool {
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator==(const Iterator& other) const -> bool {
     return current == other.current;
-} 
+}
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator!=(const Iterator& other) const -> bool {
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator!=(const Iterator& other) const -> bool {
     return !(*this == other);
-} 
+}
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator++() -> Iterator& {
-    current = current->next;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator++() -> Iterator& {
+    current = current->links()[0].next;
     return *this;
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator++(int) -> Iterator {
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator++(int) -> Iterator {
     Iterator prev(*this);
-    ++this;
+    ++*this;
     return prev;
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator--() -> Iterator& {
-    current = current->prev;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator--() -> Iterator& {
+    current = current ? current->prev : map->tail;
     return *this;
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::Iterator::operator--(int) -> Iterator {
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Iterator::operator--(int) -> Iterator {
     Iterator prev(*this);
-    --this;
+    --*this;
     return prev;
 }
 
-template <typename Key, typename Value, typename Compare>
-OrderedSkipListMap<Key, Value, Compare>::OrderedSkipListMap(Compare compare)
-: entries({{}, {}})
-, less(std::move(compare))
-, top_left(new Entry())
-, top_right(new Entry())
-, bottom_left(top_left)
-, bottom_right(top_right) {
-    top_left->entry = &entries.front();
-    bottom_left->entry = &entries.back();
-    top_left->next = top_right;
-    top_right->prev = top_left;
-}
-
-template <typename Key, typename Value, typename Compare>
-OrderedSkipListMap<Key, Value, Compare>::OrderedSkipListMap(const OrderedSkipListMap& other)
-: entries({{}, {}})
-, less(other.less)
-, top_left(new Entry())
-, top_right(new Entry())
-, bottom_left(top_left)
-, bottom_right(top_right) {
-    top_left->entry = &entries.front();
-    bottom_left->entry = &entries.back();
-    top_left->next = top_right;
-    top_right->prev = top_left;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+OrderedSkipListMap<Key, Value, Compare, Allocator>::Range::Range(Iterator first, Iterator last)
+: first{first}
+, last{last} {}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Range::begin() const -> Iterator {
+    return first;
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Range::end() const -> Iterator {
+    return last;
+}
 
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::Range::empty() const -> bool {
+    return first == last;
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+OrderedSkipListMap<Key, Value, Compare, Allocator>::OrderedSkipListMap(Compare compare, vds::SkipListLevelGenerator levels, const Allocator& allocator)
+: less(std::move(compare))
+, levels(levels)
+, allocator(allocator) {}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+OrderedSkipListMap<Key, Value, Compare, Allocator>::OrderedSkipListMap(const OrderedSkipListMap& other)
+: less(other.less)
+, levels(other.levels)
+, allocator(UnitTraits::select_on_container_copy_construction(other.allocator)) {
+    _append(other);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::operator=(const OrderedSkipListMap& other) -> OrderedSkipListMap& {
+    if (this != &other) {
+        clear();
+        if constexpr (UnitTraits::propagate_on_container_copy_assignment::value)
+            allocator = other.allocator;
+        less = other.less;
+        levels = other.levels;
+        _append(other);
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+OrderedSkipListMap<Key, Value, Compare, Allocator>::OrderedSkipListMap(OrderedSkipListMap&& other)
+: less(other.less)
+, levels(other.levels)
+, allocator(other.allocator)
+{
+    _swap_contents(other);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::operator=(OrderedSkipListMap&& other) -> OrderedSkipListMap& {
+    if (this == &other)
+        return *this;
+    clear();
+    if constexpr (UnitTraits::propagate_on_container_move_assignment::value)
+        allocator = other.allocator;
+    if (allocator == other.allocator) {
+        _swap_contents(other);
+    } else {
+        // Nodes cannot change hands between allocators that differ.
+        less = other.less;
+        levels = other.levels;
+        _append(other);
+        other.clear();
+    }
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::get_allocator() const -> Allocator {
+    return Allocator(allocator);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_swap_contents(OrderedSkipListMap& other) -> void {
+    using std::swap;
+    swap(less, other.less);
+    swap(levels, other.levels);
+    swap(head, other.head);
+    swap(tail, other.tail);
+    swap(level, other.level);
+    swap(element_count, other.element_count);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_append(const OrderedSkipListMap& other) -> void {
     for (auto it = other.begin(); it != other.end(); ++it) {
         insert(it->first, it->second);
     }
-}    
+}
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::operator=(OrderedSkipListMap other) -> OrderedSkipListMap& {
-    swap(*this, other);
-    return *this;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::begin() const -> Iterator {
+    return Iterator(head[0].next, this);
 }
 
-template <typename Key, typename Value, typename Compare>
-OrderedSkipListMap<Key, Value, Compare>::OrderedSkipListMap(OrderedSkipListMap&& other)
-: OrderedSkipListMap()
-{
-    swap(*this, other);
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::end() const -> Iterator {
+    return Iterator(nullptr, this);
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::begin() const -> Iterator {
-    return Iterator(bottom_left->next);
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::rbegin() const -> ReverseIterator {
+    return ReverseIterator(end());
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::end() const -> Iterator {
-    return Iterator(bottom_right);
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::rend() const -> ReverseIterator {
+    return ReverseIterator(begin());
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::size() const -> size_t {
-    return entries.size() - 2;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::size() const -> size_t {
+    return element_count;
 }
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::empty() const -> bool {
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::empty() const -> bool {
     return size() == 0;
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::_find_after(const Key& key) const -> Entry* {
-    auto it = top_left->next;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_links(Node* node) -> Link* {
+    return node ? node->links() : head.data();
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_links(Node* node) const -> const Link* {
+    return node ? node->links() : head.data();
+}
 
-    do {
-        while (not it->is_inf() and less(key, it->key())) {
-            it = it->next;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename GoesRight>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_descend(GoesRight goes_right, Node** predecessors, size_t* ranks) const -> std::pair<Node*, size_t> {
+    // Walk right while goes_right holds for the next link, then go one level
+    // down from the last node it held for, until the bottom level. The last
+    // node of every level and its position are recorded for insert and erase.
+    Node* it = nullptr;
+    size_t position = 0;
+    for (size_t current_level = level; current_level-- > 0;) {
+        const Link* link;
+        while ((link = &_links(it)[current_level])->next and goes_right(*link, position)) {
+            position += link->width;
+            it = link->next;
         }
-        it = it->is_bottom() ? it : it->below;
-    } while (!it->is_bottom());
+        if (predecessors)
+            predecessors[current_level] = it;
+        if (ranks)
+            ranks[current_level] = position;
+    }
+    return {it, position};
+}
 
-    return it;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_find_after(const K& key, Node** predecessors, size_t* ranks) const -> Node* {
+    auto before_key_ptr = _descend([&](const Link& link, size_t) {
+        return less(link.next->key(), key);
+    }, predecessors, ranks).first;
+    return _links(before_key_ptr)[0].next;
 }
 
-template <typename Key, typename Value, typename Compare>
-void OrderedSkipListMap<Key, Value, Compare>::_create_layer_above()
-{
-        auto new_left_ptr = new Entry();
-        new_left_ptr->below = top_left;
-        new_left_ptr->entry = &entries.back();
-        top_left->above = new_left_ptr;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_upper_bound(const K& key) const -> Node* {
+    auto last_ptr = _descend([&](const Link& link, size_t) {
+        return not less(key, link.next->key());
+    }).first;
+    return _links(last_ptr)[0].next;
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_find(const K& key) const -> Node* {
+    auto after_key_ptr = _find_after(key);
+    return after_key_ptr and not less(key, after_key_ptr->key()) ? after_key_ptr : nullptr;
+}
 
-        auto new_right_ptr = new Entry();
-        new_right_ptr->below = top_right;
-        new_right_ptr->entry = &*(++entries.begin());
-        top_right->above = new_right_ptr;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_equal_range(const K& key) const -> std::pair<Iterator, Iterator> {
+    // Keys are unique, so the range holds at most the entry lower_bound found.
+    Iterator it(_find_after(key), this);
+    if (it == end() or less(key, it->first))
+        return {it, it};
+    return {it, std::next(it)};
+}
 
-        new_left_ptr->next = new_right_ptr;
-        new_right_ptr->prev = new_left_ptr;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_count(const K& key) const -> size_t {
+    return _find(key) != nullptr;
+}
 
-        top_left = new_left_ptr;
-        top_right = new_right_ptr;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_rank(const K& key) const -> size_t {
+    return _descend([&](const Link& link, size_t) {
+        return less(link.next->key(), key);
+    }).second;
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::find(const Key& key) const -> Iterator {
-    auto after_key_ptr = _find_after(key);
-    return Iterator(after_key_ptr);
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_count_in_range(const K& lo, const K& hi) const -> size_t {
+    if (not less(lo, hi))
+        return 0;
+    return _rank(hi) - _rank(lo);
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::insert(Key key, Value value) -> Iterator {
-    std::cout << "inserting!\n";
-    auto after_key_ptr = _find_after(key);
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_random_height() -> size_t {
+    return std::min(levels(), max_level);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::find(const Key& key) const -> Iterator {
+    return Iterator(_find(key), this);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::find(const K& key) const -> Iterator {
+    return Iterator(_find(key), this);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::lower_bound(const Key& key) const -> Iterator {
+    return Iterator(_find_after(key), this);
+}
 
-    if (not after_key_ptr->is_inf() and not less(after_key_ptr->key(), key)) {
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::lower_bound(const K& key) const -> Iterator {
+    return Iterator(_find_after(key), this);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::upper_bound(const Key& key) const -> Iterator {
+    return Iterator(_upper_bound(key), this);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::upper_bound(const K& key) const -> Iterator {
+    return Iterator(_upper_bound(key), this);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::equal_range(const Key& key) const -> std::pair<Iterator, Iterator> {
+    return _equal_range(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::equal_range(const K& key) const -> std::pair<Iterator, Iterator> {
+    return _equal_range(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::range(const Key& lo, const Key& hi) const -> Range {
+    if (not less(lo, hi))
+        return Range(end(), end());
+    return Range(lower_bound(lo), lower_bound(hi));
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::range(const K& lo, const K& hi) const -> Range {
+    if (not less(lo, hi))
+        return Range(end(), end());
+    return Range(lower_bound(lo), lower_bound(hi));
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::count(const Key& key) const -> size_t {
+    return _count(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::count(const K& key) const -> size_t {
+    return _count(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::nth(size_t k) const -> Iterator {
+    if (k >= element_count)
+        return end();
+    // Positions start at 1 for the first entry, the head sits at 0.
+    auto node_ptr = _descend([&](const Link& link, size_t position) {
+        return position + link.width <= k + 1;
+    }).first;
+    return Iterator(node_ptr, this);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::rank(const Key& key) const -> size_t {
+    return _rank(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::rank(const K& key) const -> size_t {
+    return _rank(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::count_in_range(const Key& lo, const Key& hi) const -> size_t {
+    return _count_in_range(lo, hi);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::count_in_range(const K& lo, const K& hi) const -> size_t {
+    return _count_in_range(lo, hi);
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::insert(Key key, Value value) -> Iterator {
+    Predecessors predecessors;
+    Ranks ranks;
+    auto after_key_ptr = _find_after(key, predecessors.data(), ranks.data());
+
+    if (after_key_ptr and not less(key, after_key_ptr->key())) {
         // TODO: notify callee that no insertion actually happened
-        return Iterator(after_key_ptr);
+        return Iterator(after_key_ptr, this);
     }
 
-    entries.push_back({std::move(key), std::move(value)});
-    auto new_entry_ptr = new Entry();
-    new_entry_ptr->entry = &entries.back();
-    new_entry_ptr->next = after_key_ptr;
-    new_entry_ptr->prev = after_key_ptr->prev;
-
-    after_key_ptr->prev->next = new_entry_ptr;
-    after_key_ptr->prev = new_entry_ptr;
+    auto height = _random_height();
+    VDS_TRACE(TowerHeight, height);
+    for (; level < height; ++level) {
+        predecessors[level] = nullptr;
+        ranks[level] = 0;
+    }
 
-    auto left_ptr = bottom_left, right_ptr = bottom_right;
-    auto new_entry_current_level_ptr = new_entry_ptr;
-    while (rand() % 2 == 0) {
-        if (left_ptr->above == nullptr) {
-            _create_layer_above();
-        }
+    // Links that jump over the new node get one step longer, the ones it cuts
+    // in two are split at its position.
+    auto position = ranks[0] + 1;
+    auto new_node_ptr = Node::create(allocator, height, std::move(key), std::move(value));
+    for (size_t current_level = 0; current_level < height; ++current_level) {
+        auto& predecessor_link = _links(predecessors[current_level])[current_level];
+        new_node_ptr->links()[current_level] = {
+            predecessor_link.next,
+            ranks[current_level] + predecessor_link.width + 1 - position
+        };
+        predecessor_link = {new_node_ptr, position - ranks[current_level]};
+    }
+    for (size_t current_level = height; current_level < level; ++current_level) {
+        _links(predecessors[current_level])[current_level].width++;
+    }
 
-        auto new_entry_above_ptr = new Entry();
-        new_entry_above_ptr->entry = &entries.back();
+    new_node_ptr->prev = predecessors[0];
+    if (after_key_ptr)
+        after_key_ptr->prev = new_node_ptr;
+    else
+        tail = new_node_ptr;
 
-        auto closest_above_left = new_entry_current_level_ptr->prev;
-        while (not closest_above_left->above) closest_above_left = closest_above_left->prev;
-        closest_above_left = closest_above_left->above;
+    element_count++;
+    return Iterator(new_node_ptr, this);
+}
 
-        auto closest_above_right = new_entry_current_level_ptr->next;
-        while (not closest_above_right->above) closest_above_right = closest_above_right->next;
-        closest_above_right = closest_above_right->above;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::_erase(const K& key) -> void {
+    Predecessors predecessors;
+    auto node_ptr = _find_after(key, predecessors.data());
+    if (not node_ptr or less(key, node_ptr->key()))
+        return;
+
+    // On every level the node is part of, its predecessor points right at it.
+    // Above that, the predecessor's link jumps over it.
+    for (size_t current_level = 0; current_level < node_ptr->height; ++current_level) {
+        auto& predecessor_link = _links(predecessors[current_level])[current_level];
+        auto& node_link = node_ptr->links()[current_level];
+        predecessor_link = {node_link.next, predecessor_link.width + node_link.width - 1};
+    }
+    for (size_t current_level = node_ptr->height; current_level < level; ++current_level) {
+        _links(predecessors[current_level])[current_level].width--;
+    }
 
-        closest_above_left->next = new_entry_above_ptr;
-        closest_above_right->prev = new_entry_above_ptr;
+    if (auto next_ptr = node_ptr->links()[0].next)
+        next_ptr->prev = node_ptr->prev;
+    else
+        tail = node_ptr->prev;
 
-        new_entry_above_ptr->next = closest_above_right;
-        new_entry_above_ptr->prev = closest_above_left;
+    Node::destroy(allocator, node_ptr);
+    element_count--;
 
-        new_entry_current_level_ptr->above = new_entry_above_ptr;
-        
-        new_entry_current_level_ptr = new_entry_above_ptr;
-        left_ptr = left_ptr->above;
-        right_ptr = right_ptr->above;
+    while (level > 1 and head[level - 1].next == nullptr) {
+        level--;
     }
+}
 
-    return Iterator(new_entry_ptr);
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::erase(const Key& key) -> void {
+    _erase(key);
 }
 
-template <typename Key, typename Value, typename Compare>
-auto OrderedSkipListMap<Key, Value, Compare>::clear() -> void {
-    auto down_moving_ptr = top_left;
-    while (down_moving_ptr) {
-        auto below = down_moving_ptr->below;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+template <typename K, typename>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::erase(const K& key) -> void {
+    _erase(key);
+}
 
-        auto right_moving_ptr = down_moving_ptr;
-        while (right_moving_ptr) {
-            auto next = right_moving_ptr->next;
-            delete right_moving_ptr;
-            right_moving_ptr = next;
-        }
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::erase(Iterator it) -> void {
+    // The predecessors on the upper levels are only reachable from the top.
+    _erase(it->first);
+}
 
-        down_moving_ptr = below;
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::operator[](Key&& key) -> Value& {
+    if (auto node_ptr = _find(key))
+        return node_ptr->value();
+    return insert(std::forward<Key>(key), Value())->second;
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+auto OrderedSkipListMap<Key, Value, Compare, Allocator>::clear() -> void {
+    auto node_ptr = head[0].next;
+    while (node_ptr) {
+        auto next_ptr = node_ptr->links()[0].next;
+        Node::destroy(allocator, node_ptr);
+        node_ptr = next_ptr;
     }
+    head.fill(Link{nullptr, 0});
+    tail = nullptr;
+    level = 1;
+    element_count = 0;
 }
 
-template <typename Key, typename Value, typename Compare>
-OrderedSkipListMap<Key, Value, Compare>::~OrderedSkipListMap() {
-    std::cout << "destructing...\n";
+template <typename Key, typename Value, typename Compare, typename Allocator>
+OrderedSkipListMap<Key, Value, Compare, Allocator>::~OrderedSkipListMap() {
     clear();
-}
\ No newline at end of file
+}
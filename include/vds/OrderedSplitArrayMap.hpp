@@ -0,0 +1,390 @@
+#pragma once
+
+#include "OrderedArrayMap.hpp"
+#include "TypeTraits.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <utility>
+
+namespace vds {
+// Structure of arrays counterpart of OrderedArrayMap: keys and values live in
+// two parallel vectors sorted by key, so binary searches only pull keys into
+// the cache. Iterators hand out (key, value) pairs of references instead of
+// references to a stored std::pair.
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class OrderedSplitArrayMap {
+public:
+    using Entry = std::pair<Key, Value>;
+    using Reference = std::pair<const Key&, Value&>;
+    using KeyIterator = typename std::vector<Key>::iterator;
+    using ValueIterator = typename std::vector<Value>::iterator;
+    using VectorSizeType = typename std::vector<Key>::size_type;
+
+    class Iterator {
+    public:
+        friend class OrderedSplitArrayMap;
+
+        struct Pointer {
+            Reference reference;
+            Reference* operator->() { return &reference; }
+        };
+
+        Reference operator*();
+        Pointer operator->();
+        bool operator==(const Iterator&) const;
+        bool operator!=(const Iterator&) const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        Iterator& operator--();
+        Iterator operator--(int);
+    private:
+        Iterator(KeyIterator, ValueIterator);
+        KeyIterator key_it;
+        ValueIterator value_it;
+    };
+
+    OrderedSplitArrayMap(Compare compare = Compare());
+    template <typename InputIt, typename = iterator_category_t<InputIt>>
+    OrderedSplitArrayMap(InputIt first, InputIt last, Compare compare = Compare());
+    OrderedSplitArrayMap(from_sorted_unique_t, std::vector<Key> keys, std::vector<Value> values, Compare compare = Compare());
+
+    Iterator begin();
+    Iterator end();
+
+    VectorSizeType size() const;
+    bool empty() const;
+    Iterator find(const Key&);
+    Iterator lower_bound(const Key&);
+    Iterator upper_bound(const Key&);
+    std::pair<Iterator, Iterator> equal_range(const Key&);
+    Iterator insert(Key, Value);
+    template <typename InputIt, typename = iterator_category_t<InputIt>>
+    void insert(InputIt first, InputIt last);
+    void erase(const Key&);
+    void erase(Iterator);
+    VectorSizeType count(const Key&);
+    Value& operator[](Key&& key);
+
+    // Heterogeneous lookup, available when Compare declares is_transparent.
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator find(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator lower_bound(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    Iterator upper_bound(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    std::pair<Iterator, Iterator> equal_range(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    void erase(const K&);
+    template <typename K, typename = transparent_key_t<Compare, K>>
+    VectorSizeType count(const K&);
+private:
+    std::vector<Key> keys;
+    std::vector<Value> values;
+    Compare compare;
+
+    Iterator _iterator_at(KeyIterator);
+    // Inserts key before it and a value made from args at the same index,
+    // keeping both arrays the same length if either insertion throws.
+    template <typename... Args>
+    Iterator _insert_at(KeyIterator it, Key&& key, Args&&... args);
+    template <typename K>
+    KeyIterator _lower_bound(const K&);
+    template <typename K>
+    KeyIterator _upper_bound(const K&);
+    template <typename K>
+    KeyIterator _find(const K&);
+    template <typename K>
+    std::pair<Iterator, Iterator> _equal_range(const K&);
+    template <typename K>
+    void _erase(const K&);
+};
+
+template <typename Key, typename Value, typename Compare>
+OrderedSplitArrayMap<Key, Value, Compare>::Iterator::Iterator(KeyIterator key_it, ValueIterator value_it)
+: key_it(std::move(key_it))
+, value_it(std::move(value_it))
+{}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator*() -> Reference {
+    return {*key_it, *value_it};
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator->() -> Pointer {
+    return Pointer{**this};
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator==(const Iterator& rhs) const -> bool {
+    return key_it == rhs.key_it;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator!=(const Iterator& rhs) const -> bool {
+    return !(*this == rhs);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator++() -> Iterator& {
+    ++key_it;
+    ++value_it;
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator++(int) -> Iterator {
+    Iterator copy(*this);
+    ++*this;
+    return copy;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator--() -> Iterator& {
+    --key_it;
+    --value_it;
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::Iterator::operator--(int) -> Iterator {
+    Iterator copy(*this);
+    --*this;
+    return copy;
+}
+
+template <typename Key, typename Value, typename Compare>
+OrderedSplitArrayMap<Key, Value, Compare>::OrderedSplitArrayMap(Compare compare)
+: compare(std::move(compare))
+{}
+
+template <typename Key, typename Value, typename Compare>
+template <typename InputIt, typename>
+OrderedSplitArrayMap<Key, Value, Compare>::OrderedSplitArrayMap(InputIt first, InputIt last, Compare compare)
+: compare(std::move(compare))
+{
+    insert(first, last);
+}
+
+template <typename Key, typename Value, typename Compare>
+OrderedSplitArrayMap<Key, Value, Compare>::OrderedSplitArrayMap(
+    from_sorted_unique_t,
+    std::vector<Key> keys,
+    std::vector<Value> values,
+    Compare compare)
+: keys(std::move(keys))
+, values(std::move(values))
+, compare(std::move(compare))
+{}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::_iterator_at(KeyIterator key_it) -> Iterator {
+    return Iterator(key_it, values.begin() + (key_it - keys.begin()));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename... Args>
+auto OrderedSplitArrayMap<Key, Value, Compare>::_insert_at(KeyIterator it, Key&& key, Args&&... args) -> Iterator {
+    auto index = it - keys.begin();
+    values.emplace(values.begin() + index, std::forward<Args>(args)...);
+    try {
+        keys.emplace(it, std::move(key));
+    } catch (...) {
+        values.erase(values.begin() + index);
+        throw;
+    }
+    return Iterator(keys.begin() + index, values.begin() + index);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::begin() -> Iterator {
+    return Iterator(keys.begin(), values.begin());
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::end() -> Iterator {
+    return Iterator(keys.end(), values.end());
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::size() const -> VectorSizeType {
+    return keys.size();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::empty() const -> bool {
+    return keys.empty();
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto OrderedSplitArrayMap<Key, Value, Compare>::_lower_bound(const K& key) -> KeyIterator {
+    return std::lower_bound(keys.begin(), keys.end(), key, [this](const Key& stored, const K& searched) {
+        return compare(stored, searched);
+    });
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto OrderedSplitArrayMap<Key, Value, Compare>::_upper_bound(const K& key) -> KeyIterator {
+    return std::upper_bound(keys.begin(), keys.end(), key, [this](const K& searched, const Key& stored) {
+        return compare(searched, stored);
+    });
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto OrderedSplitArrayMap<Key, Value, Compare>::_find(const K& key) -> KeyIterator {
+    auto it = _lower_bound(key);
+    if (it != keys.end() && !compare(key, *it))
+        return it;
+    return keys.end();
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto OrderedSplitArrayMap<Key, Value, Compare>::_equal_range(const K& key) -> std::pair<Iterator, Iterator> {
+    auto it = _lower_bound(key);
+    if (it != keys.end() && !compare(key, *it))
+        return {_iterator_at(it), _iterator_at(it + 1)};
+    return {_iterator_at(it), _iterator_at(it)};
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K>
+auto OrderedSplitArrayMap<Key, Value, Compare>::_erase(const K& key) -> void {
+    auto it = _find(key);
+    if (it != keys.end())
+        erase(_iterator_at(it));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::find(const Key& key) -> Iterator {
+    return _iterator_at(_find(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedSplitArrayMap<Key, Value, Compare>::find(const K& key) -> Iterator {
+    return _iterator_at(_find(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::lower_bound(const Key& key) -> Iterator {
+    return _iterator_at(_lower_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedSplitArrayMap<Key, Value, Compare>::lower_bound(const K& key) -> Iterator {
+    return _iterator_at(_lower_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::upper_bound(const Key& key) -> Iterator {
+    return _iterator_at(_upper_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedSplitArrayMap<Key, Value, Compare>::upper_bound(const K& key) -> Iterator {
+    return _iterator_at(_upper_bound(key));
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::equal_range(const Key& key) -> std::pair<Iterator, Iterator> {
+    return _equal_range(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedSplitArrayMap<Key, Value, Compare>::equal_range(const K& key) -> std::pair<Iterator, Iterator> {
+    return _equal_range(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::count(const Key& key) -> VectorSizeType {
+    return _find(key) != keys.end();
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedSplitArrayMap<Key, Value, Compare>::count(const K& key) -> VectorSizeType {
+    return _find(key) != keys.end();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::insert(Key key, Value value) -> Iterator {
+    auto it = _lower_bound(key);
+    if (it != keys.end() && !compare(key, *it))
+        return _iterator_at(it);
+
+    return _insert_at(it, std::move(key), std::move(value));
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename InputIt, typename>
+auto OrderedSplitArrayMap<Key, Value, Compare>::insert(InputIt first, InputIt last) -> void {
+    // The batch is sorted as whole entries, then merged with the existing
+    // arrays into fresh ones; on equal keys the existing entry, and within the
+    // batch the first occurrence, wins.
+    std::vector<Entry> batch(first, last);
+    std::stable_sort(batch.begin(), batch.end(), [this](const Entry& lhs, const Entry& rhs) {
+        return compare(lhs.first, rhs.first);
+    });
+
+    std::vector<Key> merged_keys;
+    std::vector<Value> merged_values;
+    merged_keys.reserve(keys.size() + batch.size());
+    merged_values.reserve(values.size() + batch.size());
+
+    auto append = [&](Key&& key, Value&& value) {
+        if (!merged_keys.empty() && !compare(merged_keys.back(), key))
+            return;
+        merged_keys.push_back(std::move(key));
+        merged_values.push_back(std::move(value));
+    };
+
+    VectorSizeType index = 0;
+    for (auto& entry : batch) {
+        while (index < keys.size() && !compare(entry.first, keys[index])) {
+            append(std::move(keys[index]), std::move(values[index]));
+            ++index;
+        }
+        append(std::move(entry.first), std::move(entry.second));
+    }
+    for (; index < keys.size(); ++index)
+        append(std::move(keys[index]), std::move(values[index]));
+
+    keys = std::move(merged_keys);
+    values = std::move(merged_values);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::erase(const Key& key) -> void {
+    _erase(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename K, typename>
+auto OrderedSplitArrayMap<Key, Value, Compare>::erase(const K& key) -> void {
+    _erase(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::erase(Iterator it) -> void {
+    keys.erase(it.key_it);
+    values.erase(it.value_it);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto OrderedSplitArrayMap<Key, Value, Compare>::operator[](Key&& key) -> Value& {
+    auto it = _lower_bound(key);
+    if (it == keys.end() || compare(key, *it))
+        return *_insert_at(it, std::move(key)).value_it;
+    return values[it - keys.begin()];
+}
+}
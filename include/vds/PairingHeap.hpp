@@ -0,0 +1,361 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace vds {
+
+template <typename T>
+struct PairingHeapNode {
+    T item;
+    PairingHeapNode* child{nullptr};
+    PairingHeapNode* next{nullptr};
+    // The parent for the first child, the previous sibling for the others.
+    PairingHeapNode* prev{nullptr};
+};
+
+// A pairing heap: a tree where every node is smaller than its children, which
+// are kept in a list. insert and meld only link two roots, in O(1), and
+// removeMin pairs up the children of the old root, left to right, then links
+// the pairs right to left, in amortized O(log n). decrease_key cuts the node
+// out of its parent's list and links it with the root, and is amortized
+// o(log n).
+//
+// Melding heaps with equal allocators moves no node at all; otherwise the
+// items are moved over one by one, into nodes of this heap's allocator. The
+// default std::allocator always compares equal. To pool the nodes, give the
+// heaps PoolAllocators copied from one another, or made from the same
+// PoolArena: default constructed PoolAllocators each get an arena of their
+// own, and heaps on different arenas cannot meld in O(1).
+//
+// Handles stay valid until the item is removed, including across a meld of
+// heaps with equal allocators.
+template <typename T, typename Compare = std::less<T>, typename Allocator = std::allocator<T>>
+class PairingHeap {
+    using Node = PairingHeapNode<T>;
+public:
+    using SizeType = size_t;
+    using AllocatorType = Allocator;
+
+    class Handle {
+    public:
+        friend class PairingHeap;
+
+        Handle() = default;
+    private:
+        explicit Handle(Node*);
+        Node* node{nullptr};
+    };
+
+    friend void swap(PairingHeap& lhs, PairingHeap& rhs) {
+        using std::swap;
+        if constexpr (NodeTraits::propagate_on_container_swap::value)
+            swap(lhs.allocator, rhs.allocator);
+        swap(lhs.isLess, rhs.isLess);
+        swap(lhs.root, rhs.root);
+        swap(lhs.sz, rhs.sz);
+    }
+
+    PairingHeap(Compare = Compare(), const Allocator& = Allocator());
+    PairingHeap(const PairingHeap&);
+    PairingHeap(PairingHeap&&);
+    ~PairingHeap();
+    PairingHeap& operator=(const PairingHeap&);
+    PairingHeap& operator=(PairingHeap&&);
+
+    Handle insert(T item);
+    template <typename... Args>
+    Handle emplace(Args&&...);
+    const T& min() const;
+    void removeMin();
+    bool empty() const;
+    SizeType size() const;
+    void clear();
+
+    const T& get(Handle) const;
+    // Replaces the item with one that does not compare greater.
+    void decrease_key(Handle, T item);
+    void erase(Handle);
+    // Takes all of other's items, leaving it empty.
+    void meld(PairingHeap& other);
+
+    Allocator get_allocator() const;
+private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    Compare isLess;
+    NodeAllocator allocator;
+    Node* root{nullptr};
+    SizeType sz{0};
+
+    template <typename... Args>
+    Node* _create_node(Args&&...);
+    void _destroy_node(Node*);
+    // Links two roots, the larger one becoming the first child of the other.
+    Node* _link(Node*, Node*);
+    // The two pass pairing of a list of siblings into a single tree.
+    Node* _merge_pairs(Node* first);
+    // Takes node and its subtree out of its parent's list of children.
+    void _cut(Node*);
+    // Calls f on the item of every node, in no particular order.
+    template <typename Function>
+    void _for_each(Node* node, Function f) const;
+};
+
+template <typename T, typename Compare, typename Allocator>
+PairingHeap<T, Compare, Allocator>::Handle::Handle(Node* node)
+: node(node) {}
+
+template <typename T, typename Compare, typename Allocator>
+PairingHeap<T, Compare, Allocator>::PairingHeap(Compare isLess, const Allocator& allocator)
+: isLess(std::move(isLess))
+, allocator(allocator) {}
+
+template <typename T, typename Compare, typename Allocator>
+PairingHeap<T, Compare, Allocator>::PairingHeap(const PairingHeap& other)
+: isLess(other.isLess)
+, allocator(NodeTraits::select_on_container_copy_construction(other.allocator)) {
+    _for_each(other.root, [this](const T& item) { insert(item); });
+}
+
+template <typename T, typename Compare, typename Allocator>
+PairingHeap<T, Compare, Allocator>::PairingHeap(PairingHeap&& other)
+: isLess(other.isLess)
+, allocator(other.allocator) {
+    meld(other);
+}
+
+template <typename T, typename Compare, typename Allocator>
+PairingHeap<T, Compare, Allocator>::~PairingHeap() {
+    clear();
+}
+
+template <typename T, typename Compare, typename Allocator>
+auto PairingHeap<T, Compare, Allocator>::operator=(const PairingHeap& other) -> PairingHeap& {
+    if (this != &other) {
+        clear();
+        if constexpr (NodeTraits::propagate_on_container_copy_assignment::value)
+            allocator = other.allocator;
+        isLess = other.isLess;
+        _for_each(other.root, [this](const T& item) { insert(item); });
+    }
+    return *this;
+}
+
+template <typename T, typename Compare, typename Allocator>
+auto PairingHeap<T, Compare, Allocator>::operator=(PairingHeap&& other) -> PairingHeap& {
+    if (this != &other) {
+        clear();
+        if constexpr (NodeTraits::propagate_on_container_move_assignment::value)
+            allocator = other.allocator;
+        isLess = other.isLess;
+        meld(other);
+    }
+    return *this;
+}
+
+template <typename T, typename Compare, typename Allocator>
+auto PairingHeap<T, Compare, Allocator>::insert(T item) -> Handle {
+    return emplace(std::move(item));
+}
+
+template <typename T, typename Compare, typename Allocator>
+template <typename... Args>
+auto PairingHeap<T, Compare, Allocator>::emplace(Args&&... args) -> Handle {
+    auto node = _create_node(std::forward<Args>(args)...);
+    root = root ? _link(root, node) : node;
+    sz++;
+    return Handle(node);
+}
+
+template <typename T, typename Compare, typename Allocator>
+const T& PairingHeap<T, Compare, Allocator>::min() const {
+    return root->item;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void PairingHeap<T, Compare, Allocator>::removeMin() {
+    auto old_root = root;
+    root = _merge_pairs(old_root->child);
+    _destroy_node(old_root);
+    sz--;
+}
+
+template <typename T, typename Compare, typename Allocator>
+bool PairingHeap<T, Compare, Allocator>::empty() const {
+    return root == nullptr;
+}
+
+template <typename T, typename Compare, typename Allocator>
+auto PairingHeap<T, Compare, Allocator>::size() const -> SizeType {
+    return sz;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void PairingHeap<T, Compare, Allocator>::clear() {
+    // Seen as a binary tree of (child, next) links, rotating the child up
+    // until there is none frees the tree without a stack.
+    auto node = root;
+    while (node != nullptr) {
+        if (node->child != nullptr) {
+            auto child = node->child;
+            node->child = child->next;
+            child->next = node;
+            node = child;
+        } else {
+            auto next = node->next;
+            _destroy_node(node);
+            node = next;
+        }
+    }
+    root = nullptr;
+    sz = 0;
+}
+
+template <typename T, typename Compare, typename Allocator>
+const T& PairingHeap<T, Compare, Allocator>::get(Handle handle) const {
+    return handle.node->item;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void PairingHeap<T, Compare, Allocator>::decrease_key(Handle handle, T item) {
+    auto node = handle.node;
+    node->item = std::move(item);
+    if (node == root)
+        return;
+    _cut(node);
+    root = _link(root, node);
+}
+
+template <typename T, typename Compare, typename Allocator>
+void PairingHeap<T, Compare, Allocator>::erase(Handle handle) {
+    auto node = handle.node;
+    if (node == root) {
+        removeMin();
+        return;
+    }
+    _cut(node);
+    if (auto subtree = _merge_pairs(node->child))
+        root = _link(root, subtree);
+    _destroy_node(node);
+    sz--;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void PairingHeap<T, Compare, Allocator>::meld(PairingHeap& other) {
+    if (this == &other or other.root == nullptr)
+        return;
+    if (allocator != other.allocator) {
+        _for_each(other.root, [this](T& item) { insert(std::move(item)); });
+        other.clear();
+        return;
+    }
+    root = root ? _link(root, other.root) : other.root;
+    sz += other.sz;
+    other.root = nullptr;
+    other.sz = 0;
+}
+
+template <typename T, typename Compare, typename Allocator>
+Allocator PairingHeap<T, Compare, Allocator>::get_allocator() const {
+    return Allocator(allocator);
+}
+
+template <typename T, typename Compare, typename Allocator>
+template <typename... Args>
+auto PairingHeap<T, Compare, Allocator>::_create_node(Args&&... args) -> Node* {
+    auto node = NodeTraits::allocate(allocator, 1);
+    try {
+        ::new (static_cast<void*>(node)) Node{T(std::forward<Args>(args)...)};
+    } catch (...) {
+        NodeTraits::deallocate(allocator, node, 1);
+        throw;
+    }
+    return node;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void PairingHeap<T, Compare, Allocator>::_destroy_node(Node* node) {
+    node->~Node();
+    NodeTraits::deallocate(allocator, node, 1);
+}
+
+template <typename T, typename Compare, typename Allocator>
+auto PairingHeap<T, Compare, Allocator>::_link(Node* first, Node* second) -> Node* {
+    if (isLess(second->item, first->item))
+        std::swap(first, second);
+    second->next = first->child;
+    if (first->child != nullptr)
+        first->child->prev = second;
+    second->prev = first;
+    first->child = second;
+    return first;
+}
+
+template <typename T, typename Compare, typename Allocator>
+auto PairingHeap<T, Compare, Allocator>::_merge_pairs(Node* first) -> Node* {
+    if (first == nullptr)
+        return nullptr;
+
+    // First pass, the linked pairs are pushed on a stack through next.
+    Node* pairs = nullptr;
+    while (first != nullptr) {
+        auto a = first;
+        auto b = a->next;
+        first = b ? b->next : nullptr;
+        a->next = a->prev = nullptr;
+        if (b != nullptr) {
+            b->next = b->prev = nullptr;
+            a = _link(a, b);
+        }
+        a->next = pairs;
+        pairs = a;
+    }
+
+    // Second pass, popping them links them right to left.
+    auto result = pairs;
+    pairs = pairs->next;
+    result->next = nullptr;
+    while (pairs != nullptr) {
+        auto pair = pairs;
+        pairs = pairs->next;
+        pair->next = nullptr;
+        result = _link(result, pair);
+    }
+    return result;
+}
+
+template <typename T, typename Compare, typename Allocator>
+void PairingHeap<T, Compare, Allocator>::_cut(Node* node) {
+    if (node->prev->child == node) {
+        node->prev->child = node->next;
+    } else {
+        node->prev->next = node->next;
+    }
+    if (node->next != nullptr)
+        node->next->prev = node->prev;
+    node->next = node->prev = nullptr;
+}
+
+template <typename T, typename Compare, typename Allocator>
+template <typename Function>
+void PairingHeap<T, Compare, Allocator>::_for_each(Node* node, Function f) const {
+    std::vector<Node*> pending;
+    if (node != nullptr)
+        pending.push_back(node);
+    while (!pending.empty()) {
+        node = pending.back();
+        pending.pop_back();
+        f(node->item);
+        if (node->next != nullptr)
+            pending.push_back(node->next);
+        if (node->child != nullptr)
+            pending.push_back(node->child);
+    }
+}
+
+} // namespace vds
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace vds {
+
+// A memory resource for node based containers. Blocks up to max_block_size
+// bytes are rounded up to a multiple of the fundamental alignment, and each of
+// those size classes keeps a free list, so a freed node is handed out again to
+// the next node of the same size while it is still in cache. Fresh blocks are
+// carved out of slabs that are only returned to the system when the arena is
+// released or destroyed, all at once.
+//
+// Larger or over-aligned blocks are passed through to operator new. The arena
+// is not thread safe. It derives from std::pmr::memory_resource, so it can back
+// std::pmr::polymorphic_allocator as well as PoolAllocator.
+class PoolArena : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t granularity = alignof(std::max_align_t);
+    static constexpr std::size_t max_block_size = 512;
+    static constexpr std::size_t slab_size = 64 * 1024;
+
+    PoolArena() = default;
+    PoolArena(const PoolArena&) = delete;
+    PoolArena& operator=(const PoolArena&) = delete;
+    ~PoolArena() override;
+
+    // Frees every slab. Everything allocated from the pools is gone afterwards,
+    // so the objects living there must have been destroyed, or must not need
+    // their destructors to run.
+    void release();
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::array<FreeBlock*, max_block_size / granularity> free_lists{};
+    std::vector<void*> slabs;
+    unsigned char* slab_cursor{nullptr};
+    unsigned char* slab_end{nullptr};
+
+    static std::size_t _size_class(std::size_t bytes);
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
+
+inline PoolArena::~PoolArena() {
+    release();
+}
+
+inline auto PoolArena::release() -> void {
+    for (auto slab : slabs) {
+        ::operator delete(slab);
+    }
+    slabs.clear();
+    free_lists.fill(nullptr);
+    slab_cursor = slab_end = nullptr;
+}
+
+inline auto PoolArena::_size_class(std::size_t bytes) -> std::size_t {
+    return (std::max<std::size_t>(bytes, 1) + granularity - 1) / granularity - 1;
+}
+
+inline auto PoolArena::do_allocate(std::size_t bytes, std::size_t alignment) -> void* {
+    if (bytes > max_block_size or alignment > granularity)
+        return ::operator new(bytes, std::align_val_t(alignment));
+
+    auto size_class = _size_class(bytes);
+    if (auto block = free_lists[size_class]) {
+        free_lists[size_class] = block->next;
+        return block;
+    }
+
+    auto block_size = (size_class + 1) * granularity;
+    if (static_cast<std::size_t>(slab_end - slab_cursor) < block_size) {
+        // What is left of the current slab is dropped, slabs are big enough
+        // compared to blocks for that not to matter.
+        slabs.reserve(slabs.size() + 1);
+        slab_cursor = static_cast<unsigned char*>(::operator new(slab_size));
+        slab_end = slab_cursor + slab_size;
+        slabs.push_back(slab_cursor);
+    }
+    auto block = slab_cursor;
+    slab_cursor += block_size;
+    return block;
+}
+
+inline auto PoolArena::do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) -> void {
+    if (bytes > max_block_size or alignment > granularity) {
+        ::operator delete(pointer, std::align_val_t(alignment));
+        return;
+    }
+
+    auto size_class = _size_class(bytes);
+    free_lists[size_class] = ::new (pointer) FreeBlock{free_lists[size_class]};
+}
+
+inline auto PoolArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool {
+    return this == &other;
+}
+
+
+// Allocator handing out memory from a shared PoolArena. A default constructed
+// allocator creates an arena of its own, copies and rebound copies share it,
+// and the arena is released when the last of them is gone. Containers that
+// copy, move or swap take the allocator along, so their nodes never outlive
+// the arena they came from.
+template <typename T>
+class PoolAllocator {
+public:
+    template <typename U>
+    friend class PoolAllocator;
+
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    PoolAllocator();
+    explicit PoolAllocator(std::shared_ptr<PoolArena>);
+    // There are no move operations, moving copies, so that a container that
+    // was moved from still has an arena to allocate from.
+    PoolAllocator(const PoolAllocator&) = default;
+    PoolAllocator& operator=(const PoolAllocator&) = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&);
+
+    T* allocate(std::size_t n);
+    void deallocate(T* pointer, std::size_t n);
+
+    const std::shared_ptr<PoolArena>& arena() const;
+private:
+    std::shared_ptr<PoolArena> pool;
+};
+
+template <typename T>
+PoolAllocator<T>::PoolAllocator()
+: pool(std::make_shared<PoolArena>()) {}
+
+template <typename T>
+PoolAllocator<T>::PoolAllocator(std::shared_ptr<PoolArena> pool)
+: pool(std::move(pool)) {}
+
+template <typename T>
+template <typename U>
+PoolAllocator<T>::PoolAllocator(const PoolAllocator<U>& other)
+: pool(other.pool) {}
+
+template <typename T>
+auto PoolAllocator<T>::allocate(std::size_t n) -> T* {
+    return static_cast<T*>(pool->allocate(n * sizeof(T), alignof(T)));
+}
+
+template <typename T>
+auto PoolAllocator<T>::deallocate(T* pointer, std::size_t n) -> void {
+    pool->deallocate(pointer, n * sizeof(T), alignof(T));
+}
+
+template <typename T>
+auto PoolAllocator<T>::arena() const -> const std::shared_ptr<PoolArena>& {
+    return pool;
+}
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return lhs.arena() == rhs.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+    return !(lhs == rhs);
+}
+
+} // namespace vds
@@ -1,84 +1,238 @@
 #pragma once
 
-#include <vector>
+#include "CacheLine.hpp"
+#include "Trace.hpp"
+#include "TypeTraits.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <new>
 #include <utility>
-#include <iostream>
+#include <vector>
 
 namespace vds {
 
-template <typename T, typename Compare = std::less<typename std::vector<T>::value_type>>
+// Allocator for the array of a d-ary heap. It puts the array at an address
+// where the element at index 1 starts a cache line. With children at
+// Arity * i + 1 to Arity * i + Arity, every group of siblings then starts a
+// multiple of Arity * sizeof(T) bytes past that line, so when that size
+// divides the cache line size, no group straddles two lines.
+template <typename T>
+class HeapArrayAllocator {
+public:
+    using value_type = T;
+
+    static_assert(alignof(T) <= cache_line_size, "over-aligned elements are not supported");
+
+    HeapArrayAllocator() = default;
+    template <typename U>
+    HeapArrayAllocator(const HeapArrayAllocator<U>&) {}
+
+    T* allocate(std::size_t n);
+    void deallocate(T* pointer, std::size_t n);
+private:
+    // From the start of the aligned block to element 0.
+    static constexpr std::size_t offset = cache_line_size - sizeof(T) % cache_line_size;
+};
+
+template <typename T>
+auto HeapArrayAllocator<T>::allocate(std::size_t n) -> T* {
+    auto block = static_cast<unsigned char*>(
+        ::operator new(n * sizeof(T) + offset, std::align_val_t(cache_line_size)));
+    return reinterpret_cast<T*>(block + offset);
+}
+
+template <typename T>
+auto HeapArrayAllocator<T>::deallocate(T* pointer, std::size_t) -> void {
+    ::operator delete(reinterpret_cast<unsigned char*>(pointer) - offset, std::align_val_t(cache_line_size));
+}
+
+template <typename T, typename U>
+bool operator==(const HeapArrayAllocator<T>&, const HeapArrayAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const HeapArrayAllocator<T>&, const HeapArrayAllocator<U>&) {
+    return false;
+}
+
+
+// A d-ary min heap. A wider node makes the tree log(Arity) times shallower,
+// for Arity - 1 more comparisons per level on the way down, and with the
+// children of a node sharing a cache line those comparisons are cheap. Sifting
+// moves a hole along the path and writes the sifted item once, at the end.
+template <typename T, typename Compare = std::less<T>, std::size_t Arity = 4>
 class PriorityQueue {
 public:
+    static_assert(Arity >= 2, "a heap needs at least two children per node");
+
+    using Container = std::vector<T, HeapArrayAllocator<T>>;
+
     PriorityQueue(Compare = Compare());
+    // Builds the heap from all the items at once, bottom up, in O(n).
+    template <typename InputIt, typename = iterator_category_t<InputIt>>
+    PriorityQueue(InputIt first, InputIt last, Compare = Compare());
     void insert(T item);
+    template <typename... Args>
+    void emplace(Args&&...);
+    // Inserts all the items, rebuilding the heap bottom up instead of sifting
+    // each one up when there are enough of them for that to be cheaper.
+    template <typename InputIt, typename = iterator_category_t<InputIt>>
+    void push_range(InputIt first, InputIt last);
     const T& min() const;
-    void removeMin(); 
+    void removeMin();
     bool empty() const;
+    std::size_t size() const;
+    // Sorts the items in place, smallest first, and hands them over, leaving
+    // the queue empty.
+    Container take_sorted() &&;
 private:
-    int parent(int);
-    int leftChild(int);
-    int rightChild(int);
+    static std::size_t parent(std::size_t);
+    static std::size_t firstChild(std::size_t);
 
+    void _sift_up(std::size_t pos);
+    // Only looks at the first size items of the heap.
+    void _sift_down(std::size_t pos, T item, std::size_t size);
+    void _heapify();
 
     Compare isLess;
-    std::vector<T> heap;
+    Container heap;
 };
 
-template <typename T, typename Compare>
-PriorityQueue<T, Compare>::PriorityQueue(Compare isLess)
+template <typename T, typename Compare, std::size_t Arity>
+PriorityQueue<T, Compare, Arity>::PriorityQueue(Compare isLess)
 : isLess(std::move(isLess)) {}
 
-template <typename T, typename Compare>
-int PriorityQueue<T, Compare>::parent(int idx) {
-    return (idx - 1) / 2;
+template <typename T, typename Compare, std::size_t Arity>
+template <typename InputIt, typename>
+PriorityQueue<T, Compare, Arity>::PriorityQueue(InputIt first, InputIt last, Compare isLess)
+: isLess(std::move(isLess))
+, heap(first, last) {
+    _heapify();
 }
 
-template <typename T, typename Compare>
-int PriorityQueue<T, Compare>::leftChild(int idx) {
-    return idx * 2 + 1;
+template <typename T, typename Compare, std::size_t Arity>
+std::size_t PriorityQueue<T, Compare, Arity>::parent(std::size_t idx) {
+    return (idx - 1) / Arity;
 }
 
-template <typename T, typename Compare>
-int PriorityQueue<T, Compare>::rightChild(int idx) {
-    return idx * 2 + 2;
+template <typename T, typename Compare, std::size_t Arity>
+std::size_t PriorityQueue<T, Compare, Arity>::firstChild(std::size_t idx) {
+    return idx * Arity + 1;
 }
 
-template <typename T, typename Compare>
-void PriorityQueue<T, Compare>::insert(T item) {
+template <typename T, typename Compare, std::size_t Arity>
+void PriorityQueue<T, Compare, Arity>::insert(T item) {
     heap.push_back(std::move(item));
-    auto element_pos = heap.size() - 1;
-    while (parent(element_pos) >= 0 && isLess(heap[element_pos], heap[parent(element_pos)])) {
-        std::cout << "bubbling up...\n";
-        swap(heap[element_pos], heap[parent(element_pos)]);
-        element_pos = parent(element_pos);
+    _sift_up(heap.size() - 1);
+}
+
+template <typename T, typename Compare, std::size_t Arity>
+template <typename... Args>
+void PriorityQueue<T, Compare, Arity>::emplace(Args&&... args) {
+    heap.emplace_back(std::forward<Args>(args)...);
+    _sift_up(heap.size() - 1);
+}
+
+template <typename T, typename Compare, std::size_t Arity>
+template <typename InputIt, typename>
+void PriorityQueue<T, Compare, Arity>::push_range(InputIt first, InputIt last) {
+    auto old_size = heap.size();
+    heap.insert(heap.end(), first, last);
+    auto added = heap.size() - old_size;
+
+    // Sifting up costs at most one step per level for every new item,
+    // rebuilding costs about one step per item in the heap.
+    std::size_t depth = 0;
+    for (auto level_size = heap.size(); level_size > 0; level_size /= Arity) {
+        depth++;
+    }
+    if (added * depth > heap.size()) {
+        _heapify();
+    } else {
+        for (auto pos = old_size; pos < heap.size(); ++pos) {
+            _sift_up(pos);
+        }
     }
 }
 
-template <typename T, typename Compare>
-bool PriorityQueue<T, Compare>::empty() const {
+template <typename T, typename Compare, std::size_t Arity>
+bool PriorityQueue<T, Compare, Arity>::empty() const {
     return heap.empty();
 }
 
-template <typename T, typename Compare>
-const T& PriorityQueue<T, Compare>::min() const {
+template <typename T, typename Compare, std::size_t Arity>
+std::size_t PriorityQueue<T, Compare, Arity>::size() const {
+    return heap.size();
+}
+
+template <typename T, typename Compare, std::size_t Arity>
+const T& PriorityQueue<T, Compare, Arity>::min() const {
     return heap.front();
 }
 
-template <typename T, typename Compare>
-void PriorityQueue<T, Compare>::removeMin() {
-    swap(heap.front(), heap.back());
+template <typename T, typename Compare, std::size_t Arity>
+void PriorityQueue<T, Compare, Arity>::removeMin() {
+    auto last = std::move(heap.back());
     heap.pop_back();
-    int pos = 0;
-    while ((leftChild(pos) < heap.size() && isLess(heap[leftChild(pos)], heap[pos])) ||
-           (rightChild(pos) < heap.size() && isLess(heap[rightChild(pos)], heap[pos]))) {
-        if (leftChild(pos) < heap.size() && isLess(heap[leftChild(pos)], heap[pos])) {
-            swap(heap[pos], heap[leftChild(pos)]);
-            pos = leftChild(pos);
-        } else if (rightChild(pos) < heap.size() && isLess(heap[rightChild(pos)], heap[pos])) {
-            swap(heap[pos], heap[rightChild(pos)]);
-            pos = rightChild(pos);
+    if (!heap.empty())
+        _sift_down(0, std::move(last), heap.size());
+}
+
+template <typename T, typename Compare, std::size_t Arity>
+auto PriorityQueue<T, Compare, Arity>::take_sorted() && -> Container {
+    // Heapsort: the minimum goes behind the shrinking heap each round, which
+    // leaves the items largest first.
+    for (auto end = heap.size(); end > 1; --end) {
+        auto min = std::move(heap[0]);
+        _sift_down(0, std::move(heap[end - 1]), end - 1);
+        heap[end - 1] = std::move(min);
+    }
+    std::reverse(heap.begin(), heap.end());
+    return std::move(heap);
+}
+
+template <typename T, typename Compare, std::size_t Arity>
+void PriorityQueue<T, Compare, Arity>::_sift_up(std::size_t pos) {
+    auto sifted = std::move(heap[pos]);
+    while (pos > 0 && isLess(sifted, heap[parent(pos)])) {
+        VDS_TRACE(SiftStep, 1);
+        heap[pos] = std::move(heap[parent(pos)]);
+        pos = parent(pos);
+    }
+    heap[pos] = std::move(sifted);
+}
+
+template <typename T, typename Compare, std::size_t Arity>
+void PriorityQueue<T, Compare, Arity>::_sift_down(std::size_t pos, T item, std::size_t size) {
+    while (firstChild(pos) < size) {
+        auto first = firstChild(pos);
+        auto last = std::min(first + Arity, size);
+        auto smallest = first;
+        for (auto child = first + 1; child < last; ++child) {
+            if (isLess(heap[child], heap[smallest]))
+                smallest = child;
         }
+        if (!isLess(heap[smallest], item))
+            break;
+        VDS_TRACE(SiftStep, 1);
+        heap[pos] = std::move(heap[smallest]);
+        pos = smallest;
     }
+    heap[pos] = std::move(item);
 }
 
+template <typename T, typename Compare, std::size_t Arity>
+void PriorityQueue<T, Compare, Arity>::_heapify() {
+    // Floyd's method: sift down every inner node, last one first. Most nodes
+    // are near the bottom and only sift a level or two.
+    if (heap.size() < 2)
+        return;
+    for (auto pos = parent(heap.size() - 1) + 1; pos-- > 0;) {
+        _sift_down(pos, std::move(heap[pos]), heap.size());
+    }
 }
+
+} // namespace vds
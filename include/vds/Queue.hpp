@@ -1,49 +1,239 @@
 #pragma once
 
 #include <cstddef>
-#include "CLList.hpp"
+#include <memory>
+#include <utility>
 
 namespace vds {
 
-template <typename T>
+template <typename T, typename Allocator>
+class Queue;
+
+template <typename T, typename Allocator>
+void swap(Queue<T, Allocator>&, Queue<T, Allocator>&);
+
+// A FIFO queue over a ring buffer whose capacity is a power of two, so the
+// positions wrap with a mask. The buffer only grows, doubling when full, which
+// means a queue that has reached its working size does not allocate anymore.
+template <typename T, typename Allocator = std::allocator<T>>
 class Queue {
 public:
     using SizeType = size_t;
+    using AllocatorType = Allocator;
+
+    Queue(const Allocator& = Allocator());
+    Queue(const Queue&);
+    Queue(Queue&&);
+    ~Queue();
+    Queue& operator=(const Queue&);
+    Queue& operator=(Queue&&);
+
     void push(T e);
     void pop();
     const T& front() const;
     bool empty() const;
     SizeType size() const;
+    SizeType capacity() const;
+    // Makes room for at least n elements, so that pushing up to n does not
+    // allocate.
+    void reserve(SizeType n);
+    void clear();
+    Allocator get_allocator() const;
+
+    friend void swap<T, Allocator>(Queue&, Queue&);
 private:
-    vds::CLList<T> list;
+    using Traits = std::allocator_traits<Allocator>;
+
+    static constexpr SizeType min_capacity = 8;
+
+    Allocator allocator;
+    T* buffer{nullptr};
+    SizeType cap{0};
+    SizeType first{0};
     SizeType sz{0};
+
+    T* _slot(SizeType i) const;
+    void _grow_to(SizeType new_capacity);
+    // Destroys the elements and hands the buffer back.
+    void _release();
+    void _append(const Queue& other);
 };
 
-template <typename T>
-void Queue<T>::push(T element) {
+template <typename T, typename Allocator>
+void swap(Queue<T, Allocator>& lhs, Queue<T, Allocator>& rhs) {
+    using std::swap;
+    if constexpr (Queue<T, Allocator>::Traits::propagate_on_container_swap::value)
+        swap(lhs.allocator, rhs.allocator);
+    swap(lhs.buffer, rhs.buffer);
+    swap(lhs.cap, rhs.cap);
+    swap(lhs.first, rhs.first);
+    swap(lhs.sz, rhs.sz);
+}
+
+template <typename T, typename Allocator>
+Queue<T, Allocator>::Queue(const Allocator& allocator)
+: allocator(allocator) {}
+
+template <typename T, typename Allocator>
+Queue<T, Allocator>::Queue(const Queue& other)
+: allocator(Traits::select_on_container_copy_construction(other.allocator)) {
+    _append(other);
+}
+
+template <typename T, typename Allocator>
+Queue<T, Allocator>::Queue(Queue&& other)
+: allocator(other.allocator)
+, buffer(std::exchange(other.buffer, nullptr))
+, cap(std::exchange(other.cap, 0))
+, first(std::exchange(other.first, 0))
+, sz(std::exchange(other.sz, 0))
+{}
+
+template <typename T, typename Allocator>
+Queue<T, Allocator>::~Queue() {
+    _release();
+}
+
+template <typename T, typename Allocator>
+auto Queue<T, Allocator>::operator=(const Queue& other) -> Queue& {
+    if (this != &other) {
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            if (allocator != other.allocator)
+                _release();
+            allocator = other.allocator;
+        }
+        clear();
+        _append(other);
+    }
+    return *this;
+}
+
+template <typename T, typename Allocator>
+auto Queue<T, Allocator>::operator=(Queue&& other) -> Queue& {
+    if (this == &other)
+        return *this;
+    if (Traits::propagate_on_container_move_assignment::value or allocator == other.allocator) {
+        _release();
+        if constexpr (Traits::propagate_on_container_move_assignment::value)
+            allocator = other.allocator;
+        buffer = std::exchange(other.buffer, nullptr);
+        cap = std::exchange(other.cap, 0);
+        first = std::exchange(other.first, 0);
+        sz = std::exchange(other.sz, 0);
+    } else {
+        // The buffer cannot change hands between allocators that differ.
+        clear();
+        reserve(other.sz);
+        for (SizeType i = 0; i < other.sz; ++i) {
+            push(std::move(*other._slot(i)));
+        }
+        other.clear();
+    }
+    return *this;
+}
+
+template <typename T, typename Allocator>
+void Queue<T, Allocator>::push(T element) {
+    if (sz == cap)
+        _grow_to(cap == 0 ? min_capacity : 2 * cap);
+    Traits::construct(allocator, _slot(sz), std::move(element));
     sz++;
-    list.add(std::move(element));
 }
 
-template <typename T>
-void Queue<T>::pop() {
+template <typename T, typename Allocator>
+void Queue<T, Allocator>::pop() {
+    Traits::destroy(allocator, _slot(0));
+    first = (first + 1) & (cap - 1);
     sz--;
-    list.remove();
 }
 
-template <typename T>
-const T& Queue<T>::front() const {
-    return list.front();
+template <typename T, typename Allocator>
+const T& Queue<T, Allocator>::front() const {
+    return *_slot(0);
 }
 
-template <typename T>
-bool Queue<T>::empty() const {
-    return list.empty();
+template <typename T, typename Allocator>
+bool Queue<T, Allocator>::empty() const {
+    return sz == 0;
 }
 
-template <typename T>
-auto Queue<T>::size() const -> SizeType {
+template <typename T, typename Allocator>
+auto Queue<T, Allocator>::size() const -> SizeType {
     return sz;
 }
 
-} // namespace vds
\ No newline at end of file
+template <typename T, typename Allocator>
+auto Queue<T, Allocator>::capacity() const -> SizeType {
+    return cap;
+}
+
+template <typename T, typename Allocator>
+void Queue<T, Allocator>::reserve(SizeType n) {
+    if (n <= cap)
+        return;
+    auto new_capacity = cap == 0 ? min_capacity : cap;
+    while (new_capacity < n) {
+        new_capacity *= 2;
+    }
+    _grow_to(new_capacity);
+}
+
+template <typename T, typename Allocator>
+void Queue<T, Allocator>::clear() {
+    while (!empty()) {
+        pop();
+    }
+    first = 0;
+}
+
+template <typename T, typename Allocator>
+Allocator Queue<T, Allocator>::get_allocator() const {
+    return allocator;
+}
+
+template <typename T, typename Allocator>
+auto Queue<T, Allocator>::_slot(SizeType i) const -> T* {
+    return buffer + ((first + i) & (cap - 1));
+}
+
+template <typename T, typename Allocator>
+void Queue<T, Allocator>::_grow_to(SizeType new_capacity) {
+    auto new_buffer = Traits::allocate(allocator, new_capacity);
+    SizeType moved = 0;
+    try {
+        // The elements are unwrapped to the start of the new buffer.
+        for (; moved < sz; ++moved) {
+            Traits::construct(allocator, new_buffer + moved, std::move_if_noexcept(*_slot(moved)));
+        }
+    } catch (...) {
+        for (SizeType i = 0; i < moved; ++i) {
+            Traits::destroy(allocator, new_buffer + i);
+        }
+        Traits::deallocate(allocator, new_buffer, new_capacity);
+        throw;
+    }
+    auto count = sz;
+    _release();
+    buffer = new_buffer;
+    cap = new_capacity;
+    sz = count;
+}
+
+template <typename T, typename Allocator>
+void Queue<T, Allocator>::_release() {
+    clear();
+    if (buffer != nullptr)
+        Traits::deallocate(allocator, buffer, cap);
+    buffer = nullptr;
+    cap = 0;
+}
+
+template <typename T, typename Allocator>
+void Queue<T, Allocator>::_append(const Queue& other) {
+    reserve(sz + other.sz);
+    for (SizeType i = 0; i < other.sz; ++i) {
+        push(*other._slot(i));
+    }
+}
+
+} // namespace vds
@@ -1,14 +1,15 @@
 #pragma once
 
+#include <memory>
 #include <utility>
 
 namespace vds {
 
-template <typename T>
+template <typename T, typename Allocator>
 class SLList;
 
-template <typename T>
-void swap(SLList<T>&, SLList<T>&);
+template <typename T, typename Allocator>
+void swap(SLList<T, Allocator>&, SLList<T, Allocator>&);
 
 template <typename T>
 struct SLNode {
@@ -16,87 +17,160 @@ struct SLNode {
     SLNode* next;
 };
 
-template <typename T>
+template <typename T, typename Allocator = std::allocator<T>>
 class SLList {
 public:
-    SLList();
+    using AllocatorType = Allocator;
+
+    SLList(const Allocator& = Allocator());
     SLList(const SLList&);
     SLList(SLList&&);
     ~SLList();
-    SLList& operator=(SLList);
+    SLList& operator=(const SLList&);
+    SLList& operator=(SLList&&);
     bool empty() const;
     const T& front() const;
     void push_front(T element);
     void remove_front();
+    void clear();
+    Allocator get_allocator() const;
 
-    friend void swap<T>(SLList&, SLList&);
+    friend void swap<T, Allocator>(SLList&, SLList&);
 private:
-    SLNode<T>* head;
+    using Node = SLNode<T>;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    NodeAllocator allocator;
+    Node* head{nullptr};
+
+    Node* _create_node(T element, Node* next);
+    void _destroy_node(Node*);
+    // Appends copies of the elements of other, keeping their order.
+    void _append(const SLList& other);
 };
 
-template <typename T>
-void swap(SLList<T>& lhs, SLList<T>& rhs) {
+template <typename T, typename Allocator>
+void swap(SLList<T, Allocator>& lhs, SLList<T, Allocator>& rhs) {
     using std::swap;
+    // Without propagation, the allocators have to compare equal, as for the
+    // standard containers.
+    if constexpr (SLList<T, Allocator>::NodeTraits::propagate_on_container_swap::value)
+        swap(lhs.allocator, rhs.allocator);
     swap(lhs.head, rhs.head);
 }
 
-template <typename T>
-SLList<T>::SLList(const SLList<T>& other) {
-    while (!empty()) {
-        remove_front();
+template <typename T, typename Allocator>
+SLList<T, Allocator>::SLList(const Allocator& allocator)
+: allocator(allocator) {}
+
+template <typename T, typename Allocator>
+SLList<T, Allocator>::SLList(const SLList<T, Allocator>& other)
+: allocator(NodeTraits::select_on_container_copy_construction(other.allocator)) {
+    _append(other);
+}
+
+template <typename T, typename Allocator>
+SLList<T, Allocator>::SLList(SLList<T, Allocator>&& other)
+: allocator(other.allocator)
+, head(std::exchange(other.head, nullptr))
+{}
+
+template <typename T, typename Allocator>
+SLList<T, Allocator>& SLList<T, Allocator>::operator=(const SLList<T, Allocator>& other) {
+    if (this != &other) {
+        clear();
+        if constexpr (NodeTraits::propagate_on_container_copy_assignment::value)
+            allocator = other.allocator;
+        _append(other);
     }
-    for (auto it = other.head->next; it != nullptr; it = it->next) {
-        push_front(it->element);
+    return *this;
+}
+
+template <typename T, typename Allocator>
+SLList<T, Allocator>& SLList<T, Allocator>::operator=(SLList<T, Allocator>&& other) {
+    if (this == &other)
+        return *this;
+    clear();
+    if constexpr (NodeTraits::propagate_on_container_move_assignment::value)
+        allocator = other.allocator;
+    if (allocator == other.allocator) {
+        head = std::exchange(other.head, nullptr);
+    } else {
+        // Nodes cannot change hands between allocators that differ.
+        _append(other);
+        other.clear();
     }
+    return *this;
 }
 
-template <typename T>
-SLList<T>::SLList(SLList<T>&& other)
-:head(std::exchange(other.head, nullptr))
-{}
+template <typename T, typename Allocator>
+SLList<T, Allocator>::~SLList() {
+    clear();
+}
 
-template <typename T>
-SLList<T>::SLList() {
-    head = new SLNode<T>;
-    head->next = nullptr;
+template <typename T, typename Allocator>
+bool SLList<T, Allocator>::empty() const {
+    return head == nullptr;
 }
 
-template <typename T>
-SLList<T>& SLList<T>::operator=(SLList<T> other) {
-    swap(*this, other);
-    return this;
+template <typename T, typename Allocator>
+const T& SLList<T, Allocator>::front() const {
+    return head->element;
 }
 
-template <typename T>
-SLList<T>::~SLList() {
+template <typename T, typename Allocator>
+void SLList<T, Allocator>::push_front(T element) {
+    head = _create_node(std::move(element), head);
+}
+
+template <typename T, typename Allocator>
+void SLList<T, Allocator>::remove_front() {
+    auto current_front = head;
+    head = head->next;
+    _destroy_node(current_front);
+}
+
+template <typename T, typename Allocator>
+void SLList<T, Allocator>::clear() {
     while (!empty()) {
         remove_front();
     }
-    delete head;
 }
 
-template <typename T>
-bool SLList<T>::empty() const {
-    return head->next == nullptr;
+template <typename T, typename Allocator>
+Allocator SLList<T, Allocator>::get_allocator() const {
+    return Allocator(allocator);
 }
 
-template <typename T>
-const T& SLList<T>::front() const {
-    return head->next->element;
+template <typename T, typename Allocator>
+auto SLList<T, Allocator>::_create_node(T element, Node* next) -> Node* {
+    auto node = NodeTraits::allocate(allocator, 1);
+    try {
+        ::new (static_cast<void*>(node)) Node{std::move(element), next};
+    } catch (...) {
+        NodeTraits::deallocate(allocator, node, 1);
+        throw;
+    }
+    return node;
 }
 
-template <typename T>
-void SLList<T>::push_front(T element) {
-    auto current_front = head->next;
-    auto new_node = new SLNode<T>{std::move(element), current_front};
-    head->next = new_node;
+template <typename T, typename Allocator>
+void SLList<T, Allocator>::_destroy_node(Node* node) {
+    node->~Node();
+    NodeTraits::deallocate(allocator, node, 1);
 }
 
-template <typename T>
-void SLList<T>::remove_front() {
-    auto current_front = head->next;
-    head->next = head->next->next;
-    delete current_front;
+template <typename T, typename Allocator>
+void SLList<T, Allocator>::_append(const SLList<T, Allocator>& other) {
+    auto tail = &head;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    for (auto it = other.head; it != nullptr; it = it->next) {
+        *tail = _create_node(it->element, nullptr);
+        tail = &(*tail)->next;
+    }
 }
 
 } // namespace vds
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "CacheLine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace vds {
+
+// Bounded FIFO queue for exactly one producer thread and one consumer thread.
+// Every operation is wait-free: a push or pop either completes in a bounded
+// number of steps or reports that the queue is full or empty.
+//
+// The positions only ever grow and are masked into a power of two ring. Each
+// side keeps its own position and its last sight of the other side's on its
+// own cache line, and only looks at the other side's line again when the
+// stale copy says it has run out of room or elements.
+template <typename T>
+class SPSCQueue {
+public:
+    // The capacity is rounded up to a power of two.
+    explicit SPSCQueue(std::size_t capacity);
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+    ~SPSCQueue();
+
+    // Producer side.
+    bool try_push(const T&);
+    bool try_push(T&&);
+    template <typename... Args>
+    bool try_emplace(Args&&...);
+    // Pushes as many of the n elements starting at first as fit, publishing
+    // them all at once, and returns how many that was.
+    template <typename InputIt>
+    std::size_t try_push_n(InputIt first, std::size_t n);
+
+    // Consumer side.
+    bool try_pop(T&);
+    // Moves up to n elements to out and returns how many there were.
+    template <typename OutputIt>
+    std::size_t try_pop_n(OutputIt out, std::size_t n);
+
+    std::size_t capacity() const;
+    // Only a snapshot when the other side is running.
+    std::size_t size() const;
+    bool empty() const;
+private:
+    struct Slot {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    std::size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    alignas(cache_line_size) std::atomic<std::size_t> head{0};
+    std::size_t cached_tail{0};
+
+    alignas(cache_line_size) std::atomic<std::size_t> tail{0};
+    std::size_t cached_head{0};
+
+    void* _slot(std::size_t position) const;
+    T* _element(std::size_t position) const;
+    // Free slots as far as the producer can tell, refreshing its copy of head
+    // when it has fewer than wanted.
+    std::size_t _room(std::size_t position, std::size_t wanted);
+    // Same for the elements the consumer can take.
+    std::size_t _available(std::size_t position, std::size_t wanted);
+};
+
+template <typename T>
+SPSCQueue<T>::SPSCQueue(std::size_t capacity) {
+    std::size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    mask = rounded - 1;
+    slots = std::make_unique<Slot[]>(rounded);
+}
+
+template <typename T>
+SPSCQueue<T>::~SPSCQueue() {
+    auto end = tail.load(std::memory_order_relaxed);
+    for (auto position = head.load(std::memory_order_relaxed); position != end; ++position) {
+        _element(position)->~T();
+    }
+}
+
+template <typename T>
+auto SPSCQueue<T>::try_push(const T& element) -> bool {
+    return try_emplace(element);
+}
+
+template <typename T>
+auto SPSCQueue<T>::try_push(T&& element) -> bool {
+    return try_emplace(std::move(element));
+}
+
+template <typename T>
+template <typename... Args>
+auto SPSCQueue<T>::try_emplace(Args&&... args) -> bool {
+    auto position = tail.load(std::memory_order_relaxed);
+    if (_room(position, 1) == 0)
+        return false;
+    new (_slot(position)) T(std::forward<Args>(args)...);
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+template <typename InputIt>
+auto SPSCQueue<T>::try_push_n(InputIt first, std::size_t n) -> std::size_t {
+    auto position = tail.load(std::memory_order_relaxed);
+    auto count = std::min(n, _room(position, n));
+    for (std::size_t i = 0; i < count; ++i, ++first) {
+        new (_slot(position + i)) T(*first);
+    }
+    tail.store(position + count, std::memory_order_release);
+    return count;
+}
+
+template <typename T>
+auto SPSCQueue<T>::try_pop(T& element) -> bool {
+    auto position = head.load(std::memory_order_relaxed);
+    if (_available(position, 1) == 0)
+        return false;
+    auto slot = _element(position);
+    element = std::move(*slot);
+    slot->~T();
+    head.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+template <typename OutputIt>
+auto SPSCQueue<T>::try_pop_n(OutputIt out, std::size_t n) -> std::size_t {
+    auto position = head.load(std::memory_order_relaxed);
+    auto count = std::min(n, _available(position, n));
+    for (std::size_t i = 0; i < count; ++i, ++out) {
+        auto slot = _element(position + i);
+        *out = std::move(*slot);
+        slot->~T();
+    }
+    head.store(position + count, std::memory_order_release);
+    return count;
+}
+
+template <typename T>
+auto SPSCQueue<T>::capacity() const -> std::size_t {
+    return mask + 1;
+}
+
+template <typename T>
+auto SPSCQueue<T>::size() const -> std::size_t {
+    // head first, tail can only have moved further since.
+    auto first = head.load(std::memory_order_acquire);
+    return tail.load(std::memory_order_acquire) - first;
+}
+
+template <typename T>
+auto SPSCQueue<T>::empty() const -> bool {
+    return size() == 0;
+}
+
+template <typename T>
+auto SPSCQueue<T>::_slot(std::size_t position) const -> void* {
+    return slots[position & mask].bytes;
+}
+
+template <typename T>
+auto SPSCQueue<T>::_element(std::size_t position) const -> T* {
+    return std::launder(static_cast<T*>(_slot(position)));
+}
+
+template <typename T>
+auto SPSCQueue<T>::_room(std::size_t position, std::size_t wanted) -> std::size_t {
+    auto room = capacity() - (position - cached_head);
+    if (room < wanted) {
+        cached_head = head.load(std::memory_order_acquire);
+        room = capacity() - (position - cached_head);
+    }
+    return room;
+}
+
+template <typename T>
+auto SPSCQueue<T>::_available(std::size_t position, std::size_t wanted) -> std::size_t {
+    auto available = cached_tail - position;
+    if (available < wanted) {
+        cached_tail = tail.load(std::memory_order_acquire);
+        available = cached_tail - position;
+    }
+    return available;
+}
+
+} // namespace vds
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "HashMix.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace vds {
+
+// Picks tower heights for the skip lists. A node is promoted to the next level
+// with probability 1 / 2^promotion_shift (1/2 for a shift of 1, 1/4 for 2),
+// so the height is one plus the number of trailing zero bits of a single
+// random word, counted promotion_shift bits at a time. Words come from a
+// xorshift64* generator owned by the generator object, seeded explicitly so
+// that runs can be reproduced.
+class SkipListLevelGenerator {
+public:
+    static constexpr std::uint64_t default_seed = 0x9e3779b97f4a7c15ull;
+
+    explicit SkipListLevelGenerator(
+        std::uint64_t seed = default_seed,
+        unsigned promotion_shift = 1,
+        std::size_t max_level = 32);
+
+    void seed(std::uint64_t);
+    unsigned promotion_shift() const;
+    std::size_t max_level() const;
+
+    std::uint64_t random();
+    std::size_t height(std::uint64_t word) const;
+    std::size_t operator()();
+private:
+    std::uint64_t state;
+    unsigned shift;
+    std::size_t levels;
+};
+
+inline SkipListLevelGenerator::SkipListLevelGenerator(std::uint64_t seed, unsigned promotion_shift, std::size_t max_level)
+: shift(std::max(promotion_shift, 1u))
+, levels(std::max<std::size_t>(max_level, 1)) {
+    this->seed(seed);
+}
+
+inline auto SkipListLevelGenerator::seed(std::uint64_t seed) -> void {
+    // xorshift gets stuck on a zero state.
+    state = mix_hash(seed) | 1;
+}
+
+inline auto SkipListLevelGenerator::promotion_shift() const -> unsigned {
+    return shift;
+}
+
+inline auto SkipListLevelGenerator::max_level() const -> std::size_t {
+    return levels;
+}
+
+inline auto SkipListLevelGenerator::random() -> std::uint64_t {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dull;
+}
+
+inline auto SkipListLevelGenerator::height(std::uint64_t word) const -> std::size_t {
+    std::size_t zeros = __builtin_ctzll(word | std::uint64_t{1} << 63);
+    return std::min(1 + zeros / shift, levels);
+}
+
+inline auto SkipListLevelGenerator::operator()() -> std::size_t {
+    return height(random());
+}
+
+} // namespace vds
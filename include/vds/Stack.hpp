@@ -1,48 +1,256 @@
 #pragma once
 
-#include "SLList.hpp"
+#include <cstddef>
+#include <memory>
+#include <utility>
 
 namespace vds {
 
-template <typename T>
+// A LIFO stack over contiguous storage. The first N elements live inside the
+// stack object itself, so a stack that stays that shallow never allocates;
+// past that, the elements move to a heap buffer that doubles when full.
+template <typename T, size_t N = 16, typename Allocator = std::allocator<T>>
 class Stack {
 public:
     using SizeType = size_t;
+    using AllocatorType = Allocator;
+
+    Stack(const Allocator& = Allocator());
+    Stack(const Stack&);
+    Stack(Stack&&);
+    ~Stack();
+    Stack& operator=(const Stack&);
+    Stack& operator=(Stack&&);
+
     void push(T e);
+    template <typename... Args>
+    T& emplace(Args&&...);
     void pop();
+    T& top();
     const T& top() const;
     bool empty() const;
     SizeType size() const;
+    SizeType capacity() const;
+    // Makes room for at least n elements, so that pushing up to n does not
+    // allocate.
+    void reserve(SizeType n);
+    void clear();
+    Allocator get_allocator() const;
+
+    friend void swap(Stack& lhs, Stack& rhs) {
+        Stack temporary(std::move(lhs));
+        lhs = std::move(rhs);
+        rhs = std::move(temporary);
+    }
 private:
-    vds::SLList<T> list;
+    using Traits = std::allocator_traits<Allocator>;
+
+    Allocator allocator;
+    T* data;
+    SizeType cap{N};
     SizeType sz{0};
+    alignas(T) unsigned char inline_storage[N > 0 ? N * sizeof(T) : 1];
+
+    T* _inline();
+    bool _is_inline() const;
+    // Moves the elements to a heap buffer of the given capacity, constructing
+    // one more element from args at the end of it first, in case args refer to
+    // an element of the old buffer.
+    template <typename... Args>
+    void _relocate(SizeType new_capacity, Args&&... args);
+    // Destroys the elements and goes back to the inline storage.
+    void _release();
+    void _steal(Stack& other);
 };
 
-template <typename T>
-void Stack<T>::push(T element) {
-    list.push_front(std::move(element));
+template <typename T, size_t N, typename Allocator>
+Stack<T, N, Allocator>::Stack(const Allocator& allocator)
+: allocator(allocator)
+, data(_inline()) {}
+
+template <typename T, size_t N, typename Allocator>
+Stack<T, N, Allocator>::Stack(const Stack& other)
+: allocator(Traits::select_on_container_copy_construction(other.allocator))
+, data(_inline()) {
+    reserve(other.sz);
+    for (SizeType i = 0; i < other.sz; ++i) {
+        Traits::construct(allocator, data + i, other.data[i]);
+        sz++;
+    }
+}
+
+template <typename T, size_t N, typename Allocator>
+Stack<T, N, Allocator>::Stack(Stack&& other)
+: allocator(other.allocator)
+, data(_inline()) {
+    _steal(other);
+}
+
+template <typename T, size_t N, typename Allocator>
+Stack<T, N, Allocator>::~Stack() {
+    _release();
+}
+
+template <typename T, size_t N, typename Allocator>
+auto Stack<T, N, Allocator>::operator=(const Stack& other) -> Stack& {
+    if (this != &other) {
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            if (allocator != other.allocator)
+                _release();
+            allocator = other.allocator;
+        }
+        clear();
+        reserve(other.sz);
+        for (SizeType i = 0; i < other.sz; ++i) {
+            Traits::construct(allocator, data + i, other.data[i]);
+            sz++;
+        }
+    }
+    return *this;
+}
+
+template <typename T, size_t N, typename Allocator>
+auto Stack<T, N, Allocator>::operator=(Stack&& other) -> Stack& {
+    if (this != &other) {
+        _release();
+        if constexpr (Traits::propagate_on_container_move_assignment::value)
+            allocator = other.allocator;
+        _steal(other);
+    }
+    return *this;
+}
+
+template <typename T, size_t N, typename Allocator>
+void Stack<T, N, Allocator>::push(T element) {
+    emplace(std::move(element));
+}
+
+template <typename T, size_t N, typename Allocator>
+template <typename... Args>
+T& Stack<T, N, Allocator>::emplace(Args&&... args) {
+    if (sz == cap) {
+        _relocate(cap == 0 ? 1 : 2 * cap, std::forward<Args>(args)...);
+    } else {
+        Traits::construct(allocator, data + sz, std::forward<Args>(args)...);
+    }
     sz++;
+    return data[sz - 1];
 }
 
-template <typename T>
-void Stack<T>::pop() {
-    list.remove_front();
+template <typename T, size_t N, typename Allocator>
+void Stack<T, N, Allocator>::pop() {
     sz--;
+    Traits::destroy(allocator, data + sz);
+}
+
+template <typename T, size_t N, typename Allocator>
+T& Stack<T, N, Allocator>::top() {
+    return data[sz - 1];
 }
 
-template <typename T>
-const T& Stack<T>::top() const {
-    return list.front();
+template <typename T, size_t N, typename Allocator>
+const T& Stack<T, N, Allocator>::top() const {
+    return data[sz - 1];
 }
 
-template <typename T>
-bool Stack<T>::empty() const {
-    return list.empty();
+template <typename T, size_t N, typename Allocator>
+bool Stack<T, N, Allocator>::empty() const {
+    return sz == 0;
 }
 
-template <typename T>
-auto Stack<T>::size() const -> SizeType {
+template <typename T, size_t N, typename Allocator>
+auto Stack<T, N, Allocator>::size() const -> SizeType {
     return sz;
 }
 
+template <typename T, size_t N, typename Allocator>
+auto Stack<T, N, Allocator>::capacity() const -> SizeType {
+    return cap;
+}
+
+template <typename T, size_t N, typename Allocator>
+void Stack<T, N, Allocator>::reserve(SizeType n) {
+    if (n > cap)
+        _relocate(n);
+}
+
+template <typename T, size_t N, typename Allocator>
+void Stack<T, N, Allocator>::clear() {
+    while (!empty()) {
+        pop();
+    }
+}
+
+template <typename T, size_t N, typename Allocator>
+Allocator Stack<T, N, Allocator>::get_allocator() const {
+    return allocator;
+}
+
+template <typename T, size_t N, typename Allocator>
+auto Stack<T, N, Allocator>::_inline() -> T* {
+    return reinterpret_cast<T*>(inline_storage);
+}
+
+template <typename T, size_t N, typename Allocator>
+auto Stack<T, N, Allocator>::_is_inline() const -> bool {
+    return data == reinterpret_cast<const T*>(inline_storage);
+}
+
+template <typename T, size_t N, typename Allocator>
+template <typename... Args>
+void Stack<T, N, Allocator>::_relocate(SizeType new_capacity, Args&&... args) {
+    auto new_data = Traits::allocate(allocator, new_capacity);
+    SizeType moved = 0;
+    bool constructed = false;
+    try {
+        if constexpr (sizeof...(Args) > 0) {
+            Traits::construct(allocator, new_data + sz, std::forward<Args>(args)...);
+            constructed = true;
+        }
+        for (; moved < sz; ++moved) {
+            Traits::construct(allocator, new_data + moved, std::move_if_noexcept(data[moved]));
+        }
+    } catch (...) {
+        for (SizeType i = 0; i < moved; ++i) {
+            Traits::destroy(allocator, new_data + i);
+        }
+        if (constructed)
+            Traits::destroy(allocator, new_data + sz);
+        Traits::deallocate(allocator, new_data, new_capacity);
+        throw;
+    }
+    auto count = sz;
+    _release();
+    data = new_data;
+    cap = new_capacity;
+    sz = count;
+}
+
+template <typename T, size_t N, typename Allocator>
+void Stack<T, N, Allocator>::_release() {
+    clear();
+    if (!_is_inline())
+        Traits::deallocate(allocator, data, cap);
+    data = _inline();
+    cap = N;
+}
+
+template <typename T, size_t N, typename Allocator>
+void Stack<T, N, Allocator>::_steal(Stack& other) {
+    // Expects this stack to be empty and inline. A heap buffer can be taken
+    // over when the allocators agree, inline elements have to move one by one.
+    if (!other._is_inline() and allocator == other.allocator) {
+        data = std::exchange(other.data, other._inline());
+        cap = std::exchange(other.cap, N);
+        sz = std::exchange(other.sz, 0);
+        return;
+    }
+    reserve(other.sz);
+    for (SizeType i = 0; i < other.sz; ++i) {
+        Traits::construct(allocator, data + i, std::move(other.data[i]));
+        sz++;
+    }
+    other.clear();
+}
+
 } // namespace vds
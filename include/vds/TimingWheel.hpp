@@ -0,0 +1,268 @@
+#pragma once
+
+#include "PoolAllocator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+
+namespace vds {
+
+template <typename T>
+struct TimingWheelNode {
+    T item;
+    std::uint64_t deadline;
+    TimingWheelNode* next;
+    // The link pointing at this node, either the previous node's next or the
+    // head of the slot.
+    TimingWheelNode** pprev;
+    std::uint16_t slot;
+};
+
+// A hierarchical timing wheel, for timeouts that are mostly cancelled before
+// they fire. Time is counted in ticks. Level L has 64 slots, each covering
+// 64^L ticks, and a timer goes to the lowest level whose slots tell its
+// deadline apart from the current tick. When the current tick reaches the
+// start of a slot above level 0, its timers are spread over the levels below,
+// and a level 0 slot fires when its tick comes.
+//
+// schedule, cancel and reschedule only link or unlink a node, in O(1). A timer
+// moves down at most once per level, so advancing costs amortized O(1) per
+// timer, on top of O(levels) per tick where something happens; runs of ticks
+// where nothing does are skipped using a bitmap of the non empty slots of
+// every level.
+template <typename T, typename Allocator = PoolAllocator<T>>
+class TimingWheel {
+    using Node = TimingWheelNode<T>;
+public:
+    using Tick = std::uint64_t;
+    using SizeType = size_t;
+    using AllocatorType = Allocator;
+
+    static constexpr std::size_t slot_bits = 6;
+    static constexpr std::size_t slots_per_level = std::size_t{1} << slot_bits;
+    static constexpr std::size_t levels = (64 + slot_bits - 1) / slot_bits;
+
+    class Handle {
+    public:
+        friend class TimingWheel;
+
+        Handle() = default;
+    private:
+        explicit Handle(Node*);
+        Node* node{nullptr};
+    };
+
+    // Ticks before start count as already processed.
+    explicit TimingWheel(Tick start = 0, const Allocator& = Allocator());
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+    ~TimingWheel();
+
+    // A deadline that has already passed fires on the next advance. The
+    // handle is valid until the timer fires or is cancelled.
+    Handle schedule(Tick deadline, T item);
+    void cancel(Handle);
+    void reschedule(Handle, Tick deadline);
+    // Processes every tick up to and including now, calling fire with the
+    // item of each timer that is due, tick by tick. fire may schedule and
+    // cancel timers.
+    template <typename Function>
+    void advance(Tick now, Function&& fire);
+
+    // The first tick that has not been processed yet.
+    Tick current_tick() const;
+    SizeType size() const;
+    bool empty() const;
+private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    NodeAllocator allocator;
+    Tick current;
+    SizeType sz{0};
+    std::array<Node*, levels * slots_per_level> slots{};
+    std::array<std::uint64_t, levels> occupied{};
+
+    void _link(Node*);
+    void _unlink(Node*);
+    // The first tick from t on where a slot is due, or the largest tick.
+    Tick _next_event(Tick t) const;
+    template <typename Function>
+    void _process(Function& fire);
+    void _destroy_node(Node*);
+};
+
+template <typename T, typename Allocator>
+TimingWheel<T, Allocator>::Handle::Handle(Node* node)
+: node(node) {}
+
+template <typename T, typename Allocator>
+TimingWheel<T, Allocator>::TimingWheel(Tick start, const Allocator& allocator)
+: allocator(allocator)
+, current(start) {}
+
+template <typename T, typename Allocator>
+TimingWheel<T, Allocator>::~TimingWheel() {
+    for (auto& head : slots) {
+        while (head != nullptr) {
+            auto node = head;
+            head = node->next;
+            _destroy_node(node);
+        }
+    }
+}
+
+template <typename T, typename Allocator>
+auto TimingWheel<T, Allocator>::schedule(Tick deadline, T item) -> Handle {
+    auto node = NodeTraits::allocate(allocator, 1);
+    try {
+        ::new (static_cast<void*>(node)) Node{std::move(item), deadline, nullptr, nullptr, 0};
+    } catch (...) {
+        NodeTraits::deallocate(allocator, node, 1);
+        throw;
+    }
+    _link(node);
+    sz++;
+    return Handle(node);
+}
+
+template <typename T, typename Allocator>
+void TimingWheel<T, Allocator>::cancel(Handle handle) {
+    _unlink(handle.node);
+    _destroy_node(handle.node);
+    sz--;
+}
+
+template <typename T, typename Allocator>
+void TimingWheel<T, Allocator>::reschedule(Handle handle, Tick deadline) {
+    _unlink(handle.node);
+    handle.node->deadline = deadline;
+    _link(handle.node);
+}
+
+template <typename T, typename Allocator>
+template <typename Function>
+void TimingWheel<T, Allocator>::advance(Tick now, Function&& fire) {
+    while (current <= now) {
+        auto next = _next_event(current);
+        if (next > now) {
+            current = now + 1;
+            return;
+        }
+        current = next;
+        _process(fire);
+        current++;
+    }
+}
+
+template <typename T, typename Allocator>
+auto TimingWheel<T, Allocator>::current_tick() const -> Tick {
+    return current;
+}
+
+template <typename T, typename Allocator>
+auto TimingWheel<T, Allocator>::size() const -> SizeType {
+    return sz;
+}
+
+template <typename T, typename Allocator>
+bool TimingWheel<T, Allocator>::empty() const {
+    return sz == 0;
+}
+
+template <typename T, typename Allocator>
+void TimingWheel<T, Allocator>::_link(Node* node) {
+    auto deadline = std::max(node->deadline, current);
+    // The highest bit where the deadline differs from now picks the level.
+    auto difference = deadline ^ current;
+    std::size_t level = difference == 0 ? 0 : (63 - __builtin_clzll(difference)) / slot_bits;
+    auto index = level * slots_per_level + ((deadline >> (level * slot_bits)) & (slots_per_level - 1));
+
+    auto& head = slots[index];
+    node->slot = static_cast<std::uint16_t>(index);
+    node->next = head;
+    node->pprev = &head;
+    if (head != nullptr)
+        head->pprev = &node->next;
+    head = node;
+    occupied[level] |= std::uint64_t{1} << (index % slots_per_level);
+}
+
+template <typename T, typename Allocator>
+void TimingWheel<T, Allocator>::_unlink(Node* node) {
+    *node->pprev = node->next;
+    if (node->next != nullptr)
+        node->next->pprev = node->pprev;
+    if (slots[node->slot] == nullptr)
+        occupied[node->slot / slots_per_level] &= ~(std::uint64_t{1} << (node->slot % slots_per_level));
+}
+
+template <typename T, typename Allocator>
+auto TimingWheel<T, Allocator>::_next_event(Tick t) const -> Tick {
+    auto earliest = std::numeric_limits<Tick>::max();
+    for (std::size_t level = 0; level < levels; ++level) {
+        if (occupied[level] == 0)
+            continue;
+        auto shift = level * slot_bits;
+        // Slots above level 0 are only looked at on multiples of their span.
+        auto span = Tick{1} << shift;
+        auto base = (t + span - 1) & ~(span - 1);
+        if (base < t)
+            continue;
+        auto position = (base >> shift) & (slots_per_level - 1);
+        auto ahead = occupied[level] & (~std::uint64_t{0} << position);
+        // Without an occupied slot ahead in this turn of the level, the next
+        // turn starts over from slot 0, and that is looked at again then.
+        auto steps = ahead != 0 ? __builtin_ctzll(ahead) - position : slots_per_level - position;
+        auto tick = base + (steps << shift);
+        if (tick >= base && tick < earliest)
+            earliest = tick;
+    }
+    return earliest;
+}
+
+template <typename T, typename Allocator>
+template <typename Function>
+void TimingWheel<T, Allocator>::_process(Function& fire) {
+    // Higher levels first, so timers cascading into a lower level slot that
+    // is also due now are handled along with it.
+    for (auto level = levels - 1; level > 0; --level) {
+        auto shift = level * slot_bits;
+        if ((current & ((Tick{1} << shift) - 1)) != 0)
+            continue;
+        auto index = level * slots_per_level + ((current >> shift) & (slots_per_level - 1));
+        auto node = slots[index];
+        slots[index] = nullptr;
+        occupied[level] &= ~(std::uint64_t{1} << (index % slots_per_level));
+        while (node != nullptr) {
+            auto next = node->next;
+            _link(node);
+            node = next;
+        }
+    }
+
+    // Taking timers off one at a time lets fire cancel or add timers in this
+    // same slot.
+    auto& head = slots[current & (slots_per_level - 1)];
+    while (head != nullptr) {
+        auto node = head;
+        _unlink(node);
+        sz--;
+        auto item = std::move(node->item);
+        _destroy_node(node);
+        fire(std::move(item));
+    }
+}
+
+template <typename T, typename Allocator>
+void TimingWheel<T, Allocator>::_destroy_node(Node* node) {
+    node->~Node();
+    NodeTraits::deallocate(allocator, node, 1);
+}
+
+} // namespace vds
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Instrumentation for the containers' hot paths. VDS_TRACE(Event, value) is
+// compiled out entirely unless VDS_ENABLE_TRACING is defined, and does not even
+// evaluate value then, so tracing costs nothing on the default build. When it
+// is enabled, every event goes to vds::trace, which tallies it in counters of
+// the calling thread and never does any I/O.
+#if defined(VDS_ENABLE_TRACING)
+#define VDS_TRACE(event, value) ::vds::trace(::vds::TraceEvent::event, (value))
+#else
+#define VDS_TRACE(event, value) ((void)0)
+#endif
+
+namespace vds {
+
+enum class TraceEvent : std::size_t {
+    // One step of a heap sift, value is always 1.
+    SiftStep,
+    // Height of a tower built by a skip list insert.
+    TowerHeight,
+    // Groups or entries a hash map lookup looked at before it was done.
+    ProbeLength,
+    Count,
+};
+
+struct TraceCounters {
+    std::array<std::uint64_t, static_cast<std::size_t>(TraceEvent::Count)> events{};
+    std::array<std::uint64_t, static_cast<std::size_t>(TraceEvent::Count)> totals{};
+
+    // How many times event fired, and the sum of the values it fired with.
+    std::uint64_t count(TraceEvent event) const;
+    std::uint64_t total(TraceEvent event) const;
+    void reset();
+};
+
+inline auto TraceCounters::count(TraceEvent event) const -> std::uint64_t {
+    return events[static_cast<std::size_t>(event)];
+}
+
+inline auto TraceCounters::total(TraceEvent event) const -> std::uint64_t {
+    return totals[static_cast<std::size_t>(event)];
+}
+
+inline auto TraceCounters::reset() -> void {
+    events.fill(0);
+    totals.fill(0);
+}
+
+inline TraceCounters& trace_counters() {
+    static thread_local TraceCounters counters;
+    return counters;
+}
+
+inline void trace(TraceEvent event, std::uint64_t value) {
+    auto& counters = trace_counters();
+    counters.events[static_cast<std::size_t>(event)] += 1;
+    counters.totals[static_cast<std::size_t>(event)] += value;
+}
+
+} // namespace vds
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <iterator>
+#include <type_traits>
+
+namespace vds {
+
+// Yields K only when Function declares is_transparent, i.e. when it accepts
+// other types than the container's key. Used to enable heterogeneous lookup
+// overloads, the same way the standard associative containers do.
+template <typename Function, typename K, typename = void>
+struct transparent_key {};
+
+template <typename Function, typename K>
+struct transparent_key<Function, K, std::void_t<typename Function::is_transparent>> {
+    using type = K;
+};
+
+template <typename Function, typename K>
+using transparent_key_t = typename transparent_key<Function, K>::type;
+
+// Only well formed for iterator types, so that range overloads taking a pair
+// of iterators do not compete with overloads taking a (key, value) pair.
+template <typename It>
+using iterator_category_t = typename std::iterator_traits<It>::iterator_category;
+
+} // namespace vds
@@ -0,0 +1,543 @@
+#pragma once
+
+#include "HashMix.hpp"
+#include "Trace.hpp"
+#include "TypeTraits.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace vds {
+// A group of 16 consecutive control bytes. Every match returns a bit mask with
+// bit i set when the i-th control byte of the group satisfies the predicate,
+// so a whole group is checked with a couple of vector instructions.
+class FlatHashGroup {
+public:
+    static constexpr std::size_t width = 16;
+    static constexpr std::int8_t empty = -128;
+    static constexpr std::int8_t deleted = -2;
+
+    explicit FlatHashGroup(const std::int8_t*);
+
+    std::uint32_t match(std::int8_t) const;
+    std::uint32_t match_empty() const;
+    std::uint32_t match_free() const;
+
+    static std::size_t lowest(std::uint32_t);
+private:
+#if defined(__SSE2__)
+    __m128i controls;
+#else
+    const std::int8_t* controls;
+#endif
+};
+
+#if defined(__SSE2__)
+inline FlatHashGroup::FlatHashGroup(const std::int8_t* position)
+: controls(_mm_loadu_si128(reinterpret_cast<const __m128i*>(position)))
+{}
+
+inline auto FlatHashGroup::match(std::int8_t control) const -> std::uint32_t {
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(control))));
+}
+
+inline auto FlatHashGroup::match_free() const -> std::uint32_t {
+    // Empty and deleted are the only negative control bytes.
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(controls));
+}
+#else
+inline FlatHashGroup::FlatHashGroup(const std::int8_t* position)
+: controls(position)
+{}
+
+inline auto FlatHashGroup::match(std::int8_t control) const -> std::uint32_t {
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < width; ++i)
+        mask |= static_cast<std::uint32_t>(controls[i] == control) << i;
+    return mask;
+}
+
+inline auto FlatHashGroup::match_free() const -> std::uint32_t {
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < width; ++i)
+        mask |= static_cast<std::uint32_t>(controls[i] < 0) << i;
+    return mask;
+}
+#endif
+
+inline auto FlatHashGroup::match_empty() const -> std::uint32_t {
+    return match(empty);
+}
+
+inline auto FlatHashGroup::lowest(std::uint32_t mask) -> std::size_t {
+    return static_cast<std::size_t>(__builtin_ctz(mask));
+}
+
+// Open addressing counterpart of UnorderedHashMap. Entries live in a single
+// contiguous slot array, next to an array of control bytes that hold either
+// the state of the slot (empty/deleted) or 7 bits of the entry's hash, so a
+// probe only touches an entry when its control byte already matches. Slots
+// are probed a FlatHashGroup at a time, jumping between groups triangularly.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Equals = std::equal_to<Key>>
+class UnorderedFlatHashMap {
+public:
+    using Entry = std::pair<Key, Value>;
+    using ControlByte = std::int8_t;
+    using SizeType = std::size_t;
+
+    UnorderedFlatHashMap(
+        SizeType capacity = 16,
+        Hash hash = Hash(),
+        Equals equals = Equals());
+    UnorderedFlatHashMap(const UnorderedFlatHashMap&);
+    UnorderedFlatHashMap(UnorderedFlatHashMap&&);
+    UnorderedFlatHashMap& operator=(UnorderedFlatHashMap);
+    ~UnorderedFlatHashMap();
+
+    friend void swap(UnorderedFlatHashMap& lhs, UnorderedFlatHashMap& rhs) {
+        using std::swap;
+        swap(lhs.controls, rhs.controls);
+        swap(lhs.slots, rhs.slots);
+        swap(lhs.element_count, rhs.element_count);
+        swap(lhs.growth_left, rhs.growth_left);
+        swap(lhs.hash, rhs.hash);
+        swap(lhs.equals, rhs.equals);
+    }
+
+    class Iterator {
+    public:
+        friend class UnorderedFlatHashMap;
+
+        Entry& operator*();
+        Entry* operator->();
+        bool operator==(const Iterator&) const;
+        bool operator!=(const Iterator&) const;
+        Iterator& operator++();
+        Iterator operator++(int);
+    private:
+        Iterator(const ControlByte*, const ControlByte*, Entry*);
+        void _skip_free();
+
+        const ControlByte* control;
+        const ControlByte* control_end;
+        Entry* slot;
+    };
+
+    Iterator begin();
+    Iterator end();
+
+    SizeType size() const;
+    bool empty() const;
+    Iterator find(const Key&);
+    Iterator insert(Key, Value);
+    void erase(const Key&);
+    void erase(Iterator);
+    SizeType count(const Key&) const;
+    Value& operator[](Key&& key);
+
+    // Heterogeneous lookup, available when both Hash and Equals declare
+    // is_transparent; the argument is hashed and compared as is.
+    template <typename K, typename = transparent_key_t<Hash, transparent_key_t<Equals, K>>>
+    Iterator find(const K&);
+    template <typename K, typename = transparent_key_t<Hash, transparent_key_t<Equals, K>>>
+    void erase(const K&);
+    template <typename K, typename = transparent_key_t<Hash, transparent_key_t<Equals, K>>>
+    SizeType count(const K&) const;
+
+    SizeType bucket_count() const;
+    float load_factor() const;
+    float max_load_factor() const;
+    void rehash(SizeType);
+    void reserve(SizeType);
+private:
+    using SlotAllocator = std::allocator<Entry>;
+    using SlotTraits = std::allocator_traits<SlotAllocator>;
+
+    static constexpr ControlByte empty_control = FlatHashGroup::empty;
+    static constexpr ControlByte deleted_control = FlatHashGroup::deleted;
+
+    std::vector<ControlByte> controls;
+    Entry* slots{nullptr};
+    SizeType element_count{0};
+    // Number of empty slots that can still be claimed before the table has to
+    // grow; tombstones left by erase are not given back.
+    SizeType growth_left{0};
+    Hash hash;
+    Equals equals;
+
+    static SizeType _round_capacity(SizeType);
+    static SizeType _max_load(SizeType);
+    static SizeType _capacity_for(SizeType);
+    static SizeType _h1(std::uint64_t);
+    static ControlByte _h2(std::uint64_t);
+
+    Iterator _iterator_at(SizeType);
+    template <typename K>
+    SizeType _find_index(const K&, std::uint64_t) const;
+    SizeType _find_free(std::uint64_t) const;
+    SizeType _prepare_insert(std::uint64_t);
+    void _erase_index(SizeType);
+    void _resize(SizeType);
+    void _destroy();
+};
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::Iterator(
+    const ControlByte* control,
+    const ControlByte* control_end,
+    Entry* slot)
+: control(control)
+, control_end(control_end)
+, slot(slot)
+{
+    _skip_free();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::_skip_free() -> void {
+    while (control != control_end && *control < 0) {
+        ++control;
+        ++slot;
+    }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::operator*() -> Entry& {
+    return *slot;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::operator->() -> Entry* {
+    return slot;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::operator==(const Iterator& other) const -> bool {
+    return control == other.control;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::operator!=(const Iterator& other) const -> bool {
+    return !(*this == other);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::operator++() -> Iterator& {
+    ++control;
+    ++slot;
+    _skip_free();
+    return *this;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::Iterator::operator++(int) -> Iterator {
+    Iterator copy(*this);
+    ++*this;
+    return copy;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+UnorderedFlatHashMap<Key, Value, Hash, Equals>::UnorderedFlatHashMap(
+    SizeType capacity,
+    Hash hash,
+    Equals equals)
+: hash(std::move(hash))
+, equals(std::move(equals))
+{
+    SlotAllocator allocator;
+    capacity = _round_capacity(capacity);
+    controls.assign(capacity, empty_control);
+    slots = SlotTraits::allocate(allocator, capacity);
+    growth_left = _max_load(capacity);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+UnorderedFlatHashMap<Key, Value, Hash, Equals>::UnorderedFlatHashMap(const UnorderedFlatHashMap& other)
+: UnorderedFlatHashMap(other.controls.size(), other.hash, other.equals)
+{
+    for (SizeType index = 0; index < other.controls.size(); ++index) {
+        if (other.controls[index] >= 0)
+            insert(other.slots[index].first, other.slots[index].second);
+    }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+UnorderedFlatHashMap<Key, Value, Hash, Equals>::UnorderedFlatHashMap(UnorderedFlatHashMap&& other)
+: UnorderedFlatHashMap()
+{
+    swap(*this, other);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::operator=(UnorderedFlatHashMap other) -> UnorderedFlatHashMap& {
+    swap(*this, other);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+UnorderedFlatHashMap<Key, Value, Hash, Equals>::~UnorderedFlatHashMap() {
+    _destroy();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_round_capacity(SizeType capacity) -> SizeType {
+    SizeType rounded = FlatHashGroup::width;
+    while (rounded < capacity) rounded *= 2;
+    return rounded;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_max_load(SizeType capacity) -> SizeType {
+    return capacity - capacity / 8;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_capacity_for(SizeType elements) -> SizeType {
+    SizeType capacity = FlatHashGroup::width;
+    while (_max_load(capacity) < elements) capacity *= 2;
+    return capacity;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_h1(std::uint64_t h) -> SizeType {
+    return static_cast<SizeType>(h >> 7);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_h2(std::uint64_t h) -> ControlByte {
+    return static_cast<ControlByte>(h & 0x7f);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_iterator_at(SizeType index) -> Iterator {
+    return Iterator(controls.data() + index, controls.data() + controls.size(), slots + index);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_find_index(const K& key, std::uint64_t h) const -> SizeType {
+    const SizeType group_mask = controls.size() / FlatHashGroup::width - 1;
+    SizeType group = _h1(h) & group_mask;
+    for (SizeType step = 1;; group = (group + step++) & group_mask) {
+        const SizeType base = group * FlatHashGroup::width;
+        FlatHashGroup controls_group(controls.data() + base);
+        for (auto matches = controls_group.match(_h2(h)); matches != 0; matches &= matches - 1) {
+            auto index = base + FlatHashGroup::lowest(matches);
+            if (equals(slots[index].first, key)) {
+                VDS_TRACE(ProbeLength, step);
+                return index;
+            }
+        }
+        if (controls_group.match_empty() != 0) {
+            VDS_TRACE(ProbeLength, step);
+            return controls.size();
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_find_free(std::uint64_t h) const -> SizeType {
+    const SizeType group_mask = controls.size() / FlatHashGroup::width - 1;
+    SizeType group = _h1(h) & group_mask;
+    for (SizeType step = 1;; group = (group + step++) & group_mask) {
+        const SizeType base = group * FlatHashGroup::width;
+        auto free = FlatHashGroup(controls.data() + base).match_free();
+        if (free != 0)
+            return base + FlatHashGroup::lowest(free);
+    }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_prepare_insert(std::uint64_t h) -> SizeType {
+    auto index = _find_free(h);
+    if (growth_left == 0 && controls[index] != deleted_control) {
+        // Out of empty slots: grow, unless most of the load is tombstones, in
+        // which case rehashing at the same capacity is enough to reclaim them.
+        auto capacity = controls.size();
+        _resize(element_count + 1 > _max_load(capacity) / 2 ? capacity * 2 : capacity);
+        index = _find_free(h);
+    }
+    if (controls[index] == empty_control)
+        growth_left--;
+    controls[index] = _h2(h);
+    return index;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_erase_index(SizeType index) -> void {
+    SlotAllocator allocator;
+    SlotTraits::destroy(allocator, slots + index);
+    element_count--;
+
+    // Probes stop at the first group holding an empty slot, so if this group
+    // already has one, no probe sequence continues past it and the slot can
+    // be freed without leaving a tombstone.
+    const SizeType base = index - index % FlatHashGroup::width;
+    if (FlatHashGroup(controls.data() + base).match_empty() != 0) {
+        controls[index] = empty_control;
+        growth_left++;
+    } else {
+        controls[index] = deleted_control;
+    }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_resize(SizeType new_capacity) -> void {
+    SlotAllocator allocator;
+    auto old_controls = std::exchange(controls, std::vector<ControlByte>(new_capacity, empty_control));
+    auto old_slots = std::exchange(slots, SlotTraits::allocate(allocator, new_capacity));
+
+    for (SizeType index = 0; index < old_controls.size(); ++index) {
+        if (old_controls[index] < 0)
+            continue;
+        auto h = mix_hash(hash(old_slots[index].first));
+        auto new_index = _find_free(h);
+        controls[new_index] = _h2(h);
+        SlotTraits::construct(allocator, slots + new_index, std::move(old_slots[index]));
+        SlotTraits::destroy(allocator, old_slots + index);
+    }
+    SlotTraits::deallocate(allocator, old_slots, old_controls.size());
+    growth_left = _max_load(new_capacity) - element_count;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::_destroy() -> void {
+    if (!slots)
+        return;
+    SlotAllocator allocator;
+    for (SizeType index = 0; index < controls.size(); ++index) {
+        if (controls[index] >= 0)
+            SlotTraits::destroy(allocator, slots + index);
+    }
+    SlotTraits::deallocate(allocator, slots, controls.size());
+    slots = nullptr;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::begin() -> Iterator {
+    return _iterator_at(0);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::end() -> Iterator {
+    return _iterator_at(controls.size());
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::size() const -> SizeType {
+    return element_count;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::empty() const -> bool {
+    return element_count == 0;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::find(const Key& key) -> Iterator {
+    return _iterator_at(_find_index(key, mix_hash(hash(key))));
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K, typename>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::find(const K& key) -> Iterator {
+    return _iterator_at(_find_index(key, mix_hash(hash(key))));
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::count(const Key& key) const -> SizeType {
+    return _find_index(key, mix_hash(hash(key))) != controls.size();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K, typename>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::count(const K& key) const -> SizeType {
+    return _find_index(key, mix_hash(hash(key))) != controls.size();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::operator[](Key&& key) -> Value& {
+    auto h = mix_hash(hash(key));
+    auto index = _find_index(key, h);
+    if (index != controls.size())
+        return slots[index].second;
+
+    SlotAllocator allocator;
+    index = _prepare_insert(h);
+    SlotTraits::construct(allocator, slots + index, std::forward<Key>(key), Value());
+    element_count++;
+    return slots[index].second;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::insert(Key key, Value value) -> Iterator {
+    auto h = mix_hash(hash(key));
+    auto index = _find_index(key, h);
+    if (index != controls.size())
+        return _iterator_at(index);
+
+    SlotAllocator allocator;
+    index = _prepare_insert(h);
+    SlotTraits::construct(allocator, slots + index, std::move(key), std::move(value));
+    element_count++;
+    return _iterator_at(index);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::erase(const Key& key) -> void {
+    auto index = _find_index(key, mix_hash(hash(key)));
+    if (index != controls.size())
+        _erase_index(index);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K, typename>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::erase(const K& key) -> void {
+    auto index = _find_index(key, mix_hash(hash(key)));
+    if (index != controls.size())
+        _erase_index(index);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::erase(Iterator it) -> void {
+    _erase_index(static_cast<SizeType>(it.control - controls.data()));
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::bucket_count() const -> SizeType {
+    return controls.size();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::load_factor() const -> float {
+    return static_cast<float>(element_count) / controls.size();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::max_load_factor() const -> float {
+    return 0.875f;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::rehash(SizeType capacity) -> void {
+    capacity = std::max(_round_capacity(capacity), _capacity_for(element_count));
+    if (capacity != controls.size())
+        _resize(capacity);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedFlatHashMap<Key, Value, Hash, Equals>::reserve(SizeType elements) -> void {
+    if (_capacity_for(elements) > controls.size())
+        _resize(_capacity_for(elements));
+}
+
+}
@@ -1,8 +1,16 @@
 #pragma once
 
+#include "HashMix.hpp"
+#include "Trace.hpp"
+#include "TypeTraits.hpp"
+
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <vector>
 #include <list>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
 namespace vds {
@@ -12,191 +20,456 @@ public:
     using Entry = std::pair<Key, Value>;
     using Bucket = std::list<Entry>;
     using BucketIterator = typename std::vector<Bucket>::iterator;
+    using ConstBucketIterator = typename std::vector<Bucket>::const_iterator;
     using EntryIterator = typename Bucket::iterator;
+    using ConstEntryIterator = typename Bucket::const_iterator;
     using VectorSizeType = typename std::vector<Bucket>::size_type;
 
     UnorderedHashMap(
-        VectorSizeType buckets_count = 100,
+        VectorSizeType buckets_count = 128,
         Hash hash = Hash(),
         Equals equals = Equals());
 
-    class Iterator {
+    // Iterator when Const is false, ConstIterator when it is true, which only
+    // gives const access to the entries.
+    template <bool Const>
+    class BasicIterator {
     public:
         friend class UnorderedHashMap;
+        friend class BasicIterator<!Const>;
+
+        using Reference = std::conditional_t<Const, const Entry&, Entry&>;
+        using Pointer = std::conditional_t<Const, const Entry*, Entry*>;
+
+        template <bool WasConst, typename = std::enable_if_t<Const && !WasConst>>
+        BasicIterator(const BasicIterator<WasConst>&);
 
-        Entry& operator*();
-        Entry* operator->();
-        bool operator==(const Iterator&) const;
-        bool operator!=(const Iterator&) const;
-        Iterator& operator++();
-        Iterator operator++(int);
+        Reference operator*() const;
+        Pointer operator->() const;
+        bool operator==(const BasicIterator&) const;
+        bool operator!=(const BasicIterator&) const;
+        BasicIterator& operator++();
+        BasicIterator operator++(int);
     private:
-        Iterator() = default;
-        Iterator(
-            const std::vector<Bucket>&,
-            BucketIterator, 
-            EntryIterator);
-
-        const std::vector<Bucket>* buckets_ptr;
-        BucketIterator bucket_it;
-        EntryIterator entry_it;
+        using MapPointer = std::conditional_t<Const, const UnorderedHashMap*, UnorderedHashMap*>;
+        using BucketIt = std::conditional_t<Const, ConstBucketIterator, BucketIterator>;
+        using EntryIt = std::conditional_t<Const, ConstEntryIterator, EntryIterator>;
+
+        BasicIterator() = default;
+        BasicIterator(
+            MapPointer,
+            bool,
+            BucketIt,
+            EntryIt);
+        void _settle();
+
+        MapPointer map;
+        // Whether bucket_it points into the table that is still being drained
+        // by an incremental rehash.
+        bool in_old;
+        BucketIt bucket_it;
+        EntryIt entry_it;
     };
 
+    using Iterator = BasicIterator<false>;
+    using ConstIterator = BasicIterator<true>;
 
     Iterator begin();
     Iterator end();
+    ConstIterator begin() const;
+    ConstIterator end() const;
 
-    VectorSizeType size();
-    bool empty();
-    Iterator find(const Key&) const;
+    VectorSizeType size() const;
+    bool empty() const;
+    Iterator find(const Key&);
+    ConstIterator find(const Key&) const;
     Iterator insert(Key, Value);
     void erase(const Key&);
     void erase(Iterator);
+    VectorSizeType count(const Key&) const;
     Value& operator[](Key&& key);
+
+    // Heterogeneous lookup, available when both Hash and Equals declare
+    // is_transparent; the argument is hashed and compared as is.
+    template <typename K, typename = transparent_key_t<Hash, transparent_key_t<Equals, K>>>
+    Iterator find(const K&);
+    template <typename K, typename = transparent_key_t<Hash, transparent_key_t<Equals, K>>>
+    ConstIterator find(const K&) const;
+    template <typename K, typename = transparent_key_t<Hash, transparent_key_t<Equals, K>>>
+    void erase(const K&);
+    template <typename K, typename = transparent_key_t<Hash, transparent_key_t<Equals, K>>>
+    VectorSizeType count(const K&) const;
+
+    VectorSizeType bucket_count() const;
+    VectorSizeType bucket_size(VectorSizeType) const;
+    float load_factor() const;
+    float max_load_factor() const;
+    void max_load_factor(float);
+    void rehash(VectorSizeType);
+    void reserve(VectorSizeType);
 private:
+    // Number of old buckets moved to the new table by every insertion while
+    // an incremental rehash is in progress. Erasing does not migrate, so it
+    // leaves iterators to the other entries valid.
+    static constexpr VectorSizeType migration_step = 2;
+
     std::vector<Bucket> buckets;
+    // Table that is being migrated into `buckets`; buckets below `migrated`
+    // are already empty. Both are cleared once the migration finishes.
+    std::vector<Bucket> old_buckets;
+    VectorSizeType migrated{0};
+    VectorSizeType element_count{0};
+    float max_load{1.0f};
     Hash hash;
     Equals equals;
+
+    static VectorSizeType _round_buckets(VectorSizeType);
+    // Shared by the const and non const lookups, Self being either.
+    template <typename Self>
+    static auto _locate(Self&, std::uint64_t);
+    template <typename Self, typename K>
+    static auto _find(Self&, const K&);
+    template <typename K>
+    void _erase(const K&);
+    void _migrate(VectorSizeType);
+    void _grow_if_needed();
+    void _start_rehash(VectorSizeType);
 };
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-UnorderedHashMap<Key, Value, Hash, Equals>::Iterator::Iterator(
-    const std::vector<Bucket>& buckets_ptr,
-    BucketIterator bucket_it,
-    EntryIterator entry_it)
-: buckets_ptr(&buckets_ptr)
+template <bool Const>
+UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::BasicIterator(
+    MapPointer map,
+    bool in_old,
+    BucketIt bucket_it,
+    EntryIt entry_it)
+: map(map)
+, in_old(in_old)
 , bucket_it(bucket_it)
 , entry_it(entry_it)
 {}
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::Iterator::operator*() -> Entry& {
+template <bool Const>
+template <bool WasConst, typename>
+UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::BasicIterator(const BasicIterator<WasConst>& other)
+: map(other.map)
+, in_old(other.in_old)
+, bucket_it(other.bucket_it)
+, entry_it(other.entry_it)
+{}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <bool Const>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::_settle() -> void {
+    // Moves bucket_it forward to the first non empty bucket, going from the
+    // old table over to the new one, and points entry_it at its first entry.
+    if (in_old) {
+        while (bucket_it != map->old_buckets.end() && bucket_it->empty()) ++bucket_it;
+        if (bucket_it != map->old_buckets.end()) {
+            entry_it = bucket_it->begin();
+            return;
+        }
+        in_old = false;
+        bucket_it = map->buckets.begin();
+    }
+
+    while (bucket_it != map->buckets.end() && bucket_it->empty()) ++bucket_it;
+    entry_it = bucket_it != map->buckets.end() ? bucket_it->begin() : EntryIt();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <bool Const>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::operator*() const -> Reference {
     return *entry_it;
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::Iterator::operator->() -> Entry* {
+template <bool Const>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::operator->() const -> Pointer {
     return &(*entry_it);
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::Iterator::operator==(const Iterator& other) const -> bool {
-    return 
-        (bucket_it == other.bucket_it and entry_it == other.entry_it) || 
-        (bucket_it == buckets_ptr->end() and other.bucket_it == buckets_ptr->end());
+template <bool Const>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::operator==(const BasicIterator& other) const -> bool {
+    return in_old == other.in_old and bucket_it == other.bucket_it and entry_it == other.entry_it;
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::Iterator::operator!=(const Iterator& other) const -> bool {
+template <bool Const>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::operator!=(const BasicIterator& other) const -> bool {
     return !(*this == other);
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::Iterator::operator++() -> Iterator& {
+template <bool Const>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::operator++() -> BasicIterator& {
     entry_it++;
     if (entry_it != bucket_it->end())
         return *this;
 
-    do
-    {
-        bucket_it++;
-    } while(bucket_it->empty() and bucket_it != buckets_ptr->end());
-
-    if (bucket_it != buckets_ptr->end())
-        entry_it = bucket_it->begin();
-    
+    bucket_it++;
+    _settle();
     return *this;
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::Iterator::operator++(int) -> Iterator {
-    Iterator copy(*this);
-    ++this;
+template <bool Const>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::BasicIterator<Const>::operator++(int) -> BasicIterator {
+    BasicIterator copy(*this);
+    ++*this;
     return copy;
 }
-    
+
 template <typename Key, typename Value, typename Hash, typename Equals>
 UnorderedHashMap<Key, Value, Hash, Equals>::UnorderedHashMap(
     VectorSizeType bucket_count,
     Hash hash,
     Equals equals)
-: buckets(bucket_count)
+: buckets(_round_buckets(bucket_count))
 , hash(std::move(hash))
 , equals(std::move(equals))
 {}
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-bool UnorderedHashMap<Key, Value, Hash, Equals>::empty() {
-    return begin() == end();
+auto UnorderedHashMap<Key, Value, Hash, Equals>::_round_buckets(VectorSizeType bucket_count) -> VectorSizeType {
+    VectorSizeType rounded = 1;
+    while (rounded < bucket_count) rounded *= 2;
+    return rounded;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename Self>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::_locate(Self& self, std::uint64_t h) {
+    if (!self.old_buckets.empty()) {
+        auto old_location = h & (self.old_buckets.size() - 1);
+        if (old_location >= self.migrated)
+            return std::make_pair(true, self.old_buckets.begin() + old_location);
+    }
+    return std::make_pair(false, self.buckets.begin() + (h & (self.buckets.size() - 1)));
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::size() -> VectorSizeType {
-    return std::distance(begin(), end());
+auto UnorderedHashMap<Key, Value, Hash, Equals>::_migrate(VectorSizeType steps) -> void {
+    for (; steps > 0 && !old_buckets.empty(); --steps) {
+        auto& bucket = old_buckets[migrated];
+        while (!bucket.empty()) {
+            auto& target = buckets[mix_hash(hash(bucket.front().first)) & (buckets.size() - 1)];
+            target.splice(target.end(), bucket, bucket.begin());
+        }
+        if (++migrated == old_buckets.size()) {
+            std::vector<Bucket>().swap(old_buckets);
+            migrated = 0;
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::_start_rehash(VectorSizeType bucket_count) -> void {
+    // A rehash that is still running has to land first, there is only room
+    // for one table being drained at a time.
+    _migrate(old_buckets.size());
+    old_buckets = std::exchange(buckets, std::vector<Bucket>(bucket_count));
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::_grow_if_needed() -> void {
+    if (element_count + 1 > max_load * buckets.size())
+        _start_rehash(buckets.size() * 2);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+bool UnorderedHashMap<Key, Value, Hash, Equals>::empty() const {
+    return element_count == 0;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::size() const -> VectorSizeType {
+    return element_count;
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
 auto UnorderedHashMap<Key, Value, Hash, Equals>::begin() -> Iterator {
-    BucketIterator bucket_it = buckets.begin();
-    while (bucket_it->empty() && bucket_it != buckets.end()) ++bucket_it;
-    if (bucket_it == buckets.end())
-        return Iterator(buckets, bucket_it, EntryIterator());
-    return Iterator(buckets, bucket_it, bucket_it->begin());
+    Iterator it = old_buckets.empty()
+        ? Iterator(this, false, buckets.begin(), EntryIterator())
+        : Iterator(this, true, old_buckets.begin() + migrated, EntryIterator());
+    it._settle();
+    return it;
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
 auto UnorderedHashMap<Key, Value, Hash, Equals>::end() -> Iterator {
-    return Iterator(buckets, buckets.end(), EntryIterator());
+    return Iterator(this, false, buckets.end(), EntryIterator());
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::find(const Key& key) const -> Iterator {
-    auto location = hash(key) % buckets.size();
-    BucketIterator bucket_it = buckets.begin() + location;
+auto UnorderedHashMap<Key, Value, Hash, Equals>::begin() const -> ConstIterator {
+    ConstIterator it = old_buckets.empty()
+        ? ConstIterator(this, false, buckets.begin(), ConstEntryIterator())
+        : ConstIterator(this, true, old_buckets.begin() + migrated, ConstEntryIterator());
+    it._settle();
+    return it;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::end() const -> ConstIterator {
+    return ConstIterator(this, false, buckets.end(), ConstEntryIterator());
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename Self, typename K>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::_find(Self& self, const K& key) {
+    using It = BasicIterator<std::is_const_v<Self>>;
+    auto [in_old, bucket_it] = _locate(self, mix_hash(self.hash(key)));
     for (auto entry_it = bucket_it->begin(); entry_it != bucket_it->end(); entry_it++) {
-        if (equals(entry_it->first, key))
-            return Iterator(buckets, bucket_it, entry_it);
+        if (self.equals(entry_it->first, key)) {
+            VDS_TRACE(ProbeLength, std::distance(bucket_it->begin(), entry_it) + 1);
+            return It(&self, in_old, bucket_it, entry_it);
+        }
     }
-    return end();
+    VDS_TRACE(ProbeLength, bucket_it->size());
+    return self.end();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::find(const Key& key) -> Iterator {
+    return _find(*this, key);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::find(const Key& key) const -> ConstIterator {
+    return _find(*this, key);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K, typename>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::find(const K& key) -> Iterator {
+    return _find(*this, key);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K, typename>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::find(const K& key) const -> ConstIterator {
+    return _find(*this, key);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::count(const Key& key) const -> VectorSizeType {
+    return _find(*this, key) != end();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K, typename>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::count(const K& key) const -> VectorSizeType {
+    return _find(*this, key) != end();
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
 auto UnorderedHashMap<Key, Value, Hash, Equals>::operator[](Key&& key) -> Value& {
-    auto location = hash(key) % buckets.size();
-    BucketIterator bucket_it = buckets.begin() + location;
+    _migrate(migration_step);
+    auto h = mix_hash(hash(key));
+    auto bucket_it = _locate(*this, h).second;
     for (auto entry_it = bucket_it->begin(); entry_it != bucket_it->end(); entry_it++) {
         if (equals(entry_it->first, key))
             return entry_it->second;
     }
+    _grow_if_needed();
+    bucket_it = _locate(*this, h).second;
     bucket_it->push_back({std::forward<Key>(key), Value()});
+    element_count++;
     return bucket_it->back().second;
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
 auto UnorderedHashMap<Key, Value, Hash, Equals>::insert(Key key, Value value) -> Iterator {
-    auto location = hash(key) % buckets.size();
-    BucketIterator bucket_it = buckets.begin() + location;
+    _migrate(migration_step);
+    auto h = mix_hash(hash(key));
+    auto [in_old, bucket_it] = _locate(*this, h);
     for (auto entry_it = bucket_it->begin(); entry_it != bucket_it->end(); entry_it++) {
         if (equals(entry_it->first, key))
-            return Iterator(buckets, bucket_it, entry_it);
+            return Iterator(this, in_old, bucket_it, entry_it);
     }
+    _grow_if_needed();
+    std::tie(in_old, bucket_it) = _locate(*this, h);
     bucket_it->push_back({std::move(key), std::move(value)});
-    return Iterator(buckets, bucket_it, --bucket_it->end());
+    element_count++;
+    return Iterator(this, in_old, bucket_it, --bucket_it->end());
 }
 
 template <typename Key, typename Value, typename Hash, typename Equals>
-auto UnorderedHashMap<Key, Value, Hash, Equals>::erase(const Key& key) -> void {
-    auto location = hash(key) % buckets.size();
-    BucketIterator bucket_it = buckets.begin() + location;
+template <typename K>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::_erase(const K& key) -> void {
+    auto bucket_it = _locate(*this, mix_hash(hash(key))).second;
     for (auto entry_it = bucket_it->begin(); entry_it != bucket_it->end(); entry_it++) {
-        if (equals(entry_it->first, key))
+        if (equals(entry_it->first, key)) {
             bucket_it->erase(entry_it);
+            element_count--;
+            return;
+        }
     }
 }
 
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::erase(const Key& key) -> void {
+    _erase(key);
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+template <typename K, typename>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::erase(const K& key) -> void {
+    _erase(key);
+}
+
 template <typename Key, typename Value, typename Hash, typename Equals>
 auto UnorderedHashMap<Key, Value, Hash, Equals>::erase(Iterator it) -> void {
     it.bucket_it->erase(it.entry_it);
+    element_count--;
 }
 
-}
\ No newline at end of file
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::bucket_count() const -> VectorSizeType {
+    return buckets.size();
+}
+
+// Entries that still wait in the old table of an incremental rehash are not
+// counted; they are moved over after a handful of further insertions.
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::bucket_size(VectorSizeType index) const -> VectorSizeType {
+    return buckets[index].size();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::load_factor() const -> float {
+    return static_cast<float>(element_count) / buckets.size();
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::max_load_factor() const -> float {
+    return max_load;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::max_load_factor(float load) -> void {
+    max_load = load;
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::rehash(VectorSizeType bucket_count) -> void {
+    auto needed = static_cast<VectorSizeType>(std::ceil(element_count / max_load));
+    bucket_count = _round_buckets(std::max(bucket_count, needed));
+
+    // Unlike the automatic growth, an explicit rehash is done in one go.
+    if (bucket_count != buckets.size())
+        _start_rehash(bucket_count);
+    _migrate(old_buckets.size());
+}
+
+template <typename Key, typename Value, typename Hash, typename Equals>
+auto UnorderedHashMap<Key, Value, Hash, Equals>::reserve(VectorSizeType count) -> void {
+    auto bucket_count = static_cast<VectorSizeType>(std::ceil(count / max_load));
+    if (bucket_count > buckets.size())
+        rehash(bucket_count);
+}
+
+}
@@ -12,8 +12,6 @@
 #include <vds/OrderedSkipListMap.hpp>
 
 int main(void) {
-    srand (10);
-
     OrderedSkipListMap<std::string, int> map;
     if (map.empty()) {
         std::cout << "the map is empty...\n";